@@ -17,16 +17,34 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
 #include "file/file.h"
 #include "db/doc.h"
 
 
-static struct doc {
-	const char *ref;	/* component reference */
+/*
+ * Records are indexed by reference. Each reference has the list of its
+ * documents, in the order in which they appear in the database.
+ */
+
+struct doc {
 	const char *tag;	/* document type (shown in pop-up) */
 	const char *s;		/* string to pass to viewer */
-	struct doc *next;
-} *docs = NULL, *curr_doc = NULL;
+	struct doc *next;	/* next document with the same reference */
+};
+
+struct doc_ref {
+	const char *ref;	/* component reference */
+	struct doc *docs;
+	struct doc **next_doc;
+};
+
+
+static struct arena *arena = NULL;	/* everything below lives here */
+static struct hash *refs;		/* reference -> struct doc_ref */
+static const struct doc_ref *curr_ref = NULL;
+static struct doc *curr_doc = NULL;
 
 
 /* ----- Lookup ------------------------------------------------------------ */
@@ -35,14 +53,17 @@ static struct doc {
 bool doc_find(const char *ref,
     void (*fn)(void *user, const char *tag, const char *s), void *user)
 {
+	const struct doc_ref *r;
 	const struct doc *d;
-	bool found = 0;
-	for (d = docs; d; d = d->next)
-		if (!strcmp(d->ref, ref)) {
-			fn(user, d->tag, d->s);
-			found = 1;
-		}
-	return found;
+
+	if (!arena)
+		return 0;
+	r = hash_lookup(refs, ref);
+	if (!r)
+		return 0;
+	for (d = r->docs; d; d = d->next)
+		fn(user, d->tag, d->s);
+	return 1;
 }
 
 
@@ -53,17 +74,34 @@ static const char *untail(const char *s)
 {
 	const char *start = s;
 	const char *last = s;
-	char *new;
 
 	while (*s) {
 		if (!isspace(*s))
 			last = s;
 		s++;
 	}
-	new = alloc_size(last - start + 2);
-	memcpy(new, start, last - start + 1);
-	new[last - start + 1] = 0;
-	return new;
+	return arena_strndup(arena, start, last - start + 1);
+}
+
+
+static void add_doc(const char *ref)
+{
+	struct doc_ref *r;
+
+	r = hash_lookup(refs, ref);
+	if (!r) {
+		r = arena_alloc_type(arena, struct doc_ref);
+		r->ref = ref;
+		r->docs = NULL;
+		r->next_doc = &r->docs;
+		hash_insert(refs, ref, r);
+	}
+	curr_doc = arena_alloc_type(arena, struct doc);
+	curr_doc->tag = curr_doc->s = NULL;
+	curr_doc->next = NULL;
+	*r->next_doc = curr_doc;
+	r->next_doc = &curr_doc->next;
+	curr_ref = r;
 }
 
 
@@ -72,7 +110,6 @@ static bool parse_line(const struct file *file,
 {
 	bool *start = user;
 	const char *s = line;
-	struct doc *new;
 
 	while (1) {
 		switch (*s) {
@@ -94,24 +131,15 @@ static bool parse_line(const struct file *file,
 	}
 
 	if (*start) {
-		new = alloc_type(struct doc);
-		new->ref = new->tag = new->s = NULL;
-		new->next = NULL;
-		if (curr_doc)
-			curr_doc->next = new;
-		else
-			docs = new;
-		curr_doc = new;
+		add_doc(untail(line));
 		*start = 0;
-	}
-	if (curr_doc->s)
-		warning("ignoring extra line for \"%s\"", curr_doc->ref);
-	else if (curr_doc->tag)
+	} else if (curr_doc->s) {
+		warning("ignoring extra line for \"%s\"", curr_ref->ref);
+	} else if (curr_doc->tag) {
 		curr_doc->s = untail(line);
-	else if (curr_doc->ref)
+	} else {
 		curr_doc->tag = untail(line);
-	else
-		curr_doc->ref = untail(line);
+	}
 	return 1;
 }
 
@@ -123,6 +151,10 @@ bool doc_load(const char *name, const struct file *related)
 
 	if (!file_open(&file, name, related))
 		return 0;
+	if (!arena) {
+		arena = arena_new();
+		refs = hash_new(arena, hash_str, hash_str_eq);
+	}
 	file_read(&file, parse_line, &start);
 	file_close(&file);
 	return 1;
@@ -134,15 +166,9 @@ bool doc_load(const char *name, const struct file *related)
 
 void doc_free(void)
 {
-	struct doc *next;
-
-	while (docs) {
-		next = docs->next;
-		free((void *) docs->ref);
-		free((void *) docs->tag);
-		free((void *) docs->s);
-		free(docs);
-		docs = next;
-	}
+	if (arena)
+		arena_unref(arena);
+	arena = NULL;
+	curr_ref = NULL;
 	curr_doc = NULL;
 }
@@ -18,6 +18,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "misc/util.h"
 #include "misc/diag.h"
@@ -25,10 +26,6 @@
 #include "file/file.h"
 
 
-static char *getline_buf = NULL;
-static size_t getline_n = 0;
-
-
 void *file_oid(const struct file *file)
 {
 	if (!file->vcs)
@@ -47,6 +44,24 @@ bool file_oid_eq(const void *a, const void *b)
 }
 
 
+unsigned file_oid_hash(const void *oid)
+{
+	return vcs_git_oid_hash(oid);
+}
+
+
+void *file_oid_dup(const void *oid)
+{
+	return vcs_git_oid_dup(oid);
+}
+
+
+char *file_oid_str(const void *oid)
+{
+	return vcs_git_oid_str(oid);
+}
+
+
 static void get_time(struct file *file)
 {
 	struct stat st;
@@ -54,8 +69,12 @@ static void get_time(struct file *file)
 	if (fstat(fileno(file->file), &st)) {
 		diag_perror("fstat");
 		file->mtime = 0;
+		file->dev = 0;
+		file->ino = 0;
 	} else {
 		file->mtime = st.st_mtime;
+		file->dev = st.st_dev;
+		file->ino = st.st_ino;
 	}
 }
 
@@ -182,6 +201,8 @@ static void file_init(struct file *file, const char *name,
 	file->related = related;
 	file->file = NULL;
 	file->vcs = NULL;
+	file->dev = 0;
+	file->ino = 0;
 }
 
 
@@ -287,23 +308,92 @@ bool file_open_revision(struct file *file, const char *rev, const char *name,
 }
 
 
+/*
+ * Working-tree files are mapped privately and parsed in place: we overwrite
+ * each newline with a NUL, which only touches our copy-on-write pages, so no
+ * line gets copied. A last line without a newline is terminated by the
+ * zero-filled rest of the last page. Only if the file ends exactly at a page
+ * boundary do we have to copy that one line.
+ *
+ * Returns 0 if the file can't be mapped (e.g., it is empty or not a regular
+ * file). The caller then falls back to getline.
+ */
+
+static bool map_read(struct file *file,
+    bool (*parse)(const struct file *file, void *user, const char *line),
+    void *user, bool *res)
+{
+	struct stat st;
+	size_t size;
+	char *map, *p, *end, *nl;
+	char *tmp;
+
+	if (fstat(fileno(file->file), &st))
+		return 0;
+	if (!S_ISREG(st.st_mode) || !st.st_size)
+		return 0;
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+	    fileno(file->file), 0);
+	if (map == MAP_FAILED)
+		return 0;
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	*res = 1;
+	end = map + size;
+	for (p = map; p != end; p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		file->lineno++;
+		if (nl) {
+			*nl = 0;
+		} else if (size % sysconf(_SC_PAGESIZE)) {
+			nl = end;
+		} else {
+			tmp = alloc_size(end - p + 1);
+			memcpy(tmp, p, end - p);
+			tmp[end - p] = 0;
+			*res = parse(file, user, tmp);
+			free(tmp);
+			break;
+		}
+		if (!parse(file, user, p)) {
+			*res = 0;
+			break;
+		}
+		if (nl == end)
+			break;
+	}
+
+	munmap(map, size);
+	return 1;
+}
+
+
 bool file_read(struct file *file,
     bool (*parse)(const struct file *file, void *user, const char *line),
     void *user)
 {
+	char *buf = NULL;
+	size_t n = 0;
 	char *nl;
+	bool res = 1;
 
 	if (file->vcs)
 		return vcs_read(file->vcs, file, parse, user);
-	while (getline(&getline_buf, &getline_n, file->file) > 0) {
-		nl = strchr(getline_buf, '\n');
+	if (map_read(file, parse, user, &res))
+		return res;
+	while (getline(&buf, &n, file->file) > 0) {
+		nl = strchr(buf, '\n');
 		if (nl)
 			*nl = 0;
 		file->lineno++;
-		if (!parse(file, user, getline_buf))
-			return 0;
+		if (!parse(file, user, buf)) {
+			res = 0;
+			break;
+		}
 	}
-	return 1;
+	free(buf);
+	return res;
 }
 
 
@@ -315,9 +405,3 @@ void file_close(struct file *file)
 		vcs_close(file->vcs);
 	free((char *) file->name);
 }
-
-
-void file_cleanup(void)
-{
-	free(getline_buf);
-}
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/types.h>
 
 
 struct file {
@@ -24,12 +25,17 @@ struct file {
 	const char *name;	/* name/designator given to file_open */
 	unsigned lineno;
 	time_t mtime;		/* modification time */
+	dev_t dev;		/* device and inode of a file, 0 if VCS */
+	ino_t ino;
 	const struct file *related; /* NULL if not related to anything */
 };
 
 
 void *file_oid(const struct file *file);
 bool file_oid_eq(const void *a, const void *b);
+unsigned file_oid_hash(const void *oid);
+void *file_oid_dup(const void *oid);
+char *file_oid_str(const void *oid);
 
 bool file_cat(const struct file *file, void *user, const char *line);
 
@@ -47,6 +53,4 @@ bool file_read(struct file *file,
     void *user);
 void file_close(struct file *file);
 
-void file_cleanup(void);
-
 #endif /* !FILE_FILE_H */
@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -23,6 +24,8 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
 #include "file/file.h"
 #include "file/git-util.h"
 #include "file/git-file.h"
@@ -34,12 +37,10 @@ struct vcs_git {
 	const struct vcs_git *related;
 
 	git_repository *repo;
+	const char *repo_path;	/* for finding the repository when reading */
 	git_commit *commit;
 	git_tree *tree;
-	git_object *obj;
-
-	const void *data;
-	unsigned size;
+	git_oid oid;		/* blob */
 };
 
 
@@ -52,7 +53,7 @@ void *vcs_git_get_oid(const void *ctx)
 	struct git_oid *new;
 
 	new = alloc_type(git_oid);
-	git_oid_cpy(new, git_object_id(vcs_git->obj));
+	git_oid_cpy(new, &vcs_git->oid);
 	return new;
 }
 
@@ -63,10 +64,177 @@ bool vcs_git_oid_eq(const void *a, const void *b)
 }
 
 
+unsigned vcs_git_oid_hash(const void *oid)
+{
+	const git_oid *id = oid;
+	unsigned h;
+
+	/* the OID is already a hash, so any part of it will do */
+	memcpy(&h, id->id, sizeof(h));
+	return h;
+}
+
+
+void *vcs_git_oid_dup(const void *oid)
+{
+	struct git_oid *new;
+
+	new = alloc_type(git_oid);
+	git_oid_cpy(new, oid);
+	return new;
+}
+
+
+char *vcs_git_oid_str(const void *oid)
+{
+	char *s;
+
+	s = alloc_size(GIT_OID_HEXSZ + 1);
+	git_oid_tostr(s, GIT_OID_HEXSZ + 1, oid);
+	return s;
+}
+
+
+/* ----- Tree entry cache ------------------------------------------------- */
+
+
+/*
+ * Consecutive revisions share most of their trees. Instead of walking each
+ * path from the root with git_tree_entry_bypath, we therefore remember, for
+ * each tree we've looked into, what we found under each name. Since trees
+ * are identified by their OID, a subtree that hasn't changed is only searched
+ * once, no matter in how many revisions it appears.
+ *
+ * The cache is shared by all threads. We don't hold the lock while asking
+ * libgit2, so two threads may look up the same entry, but only the first one
+ * gets stored.
+ */
+
+struct tree_entry {
+	git_oid tree;		/* OID of the tree containing the entry */
+	const char *name;	/* name of the entry in the tree */
+	git_oid oid;		/* OID of the entry */
+	git_otype type;
+};
+
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct arena *arena = NULL;	/* for everything we share */
+static struct hash *tree_entries;	/* struct tree_entry, by tree and name */
+
+
+static void init_arena(void)
+{
+	if (!arena)
+		arena = arena_new();
+}
+
+
+static unsigned tree_entry_hash(const void *key)
+{
+	const struct tree_entry *e = key;
+
+	return vcs_git_oid_hash(&e->tree) ^ hash_str(e->name);
+}
+
+
+static bool tree_entry_eq(const void *a, const void *b)
+{
+	const struct tree_entry *ea = a;
+	const struct tree_entry *eb = b;
+
+	return git_oid_equal(&ea->tree, &eb->tree) &&
+	    !strcmp(ea->name, eb->name);
+}
+
+
+static const struct tree_entry *tree_entry(git_repository *repo,
+    const git_oid *tree_oid, const char *name)
+{
+	struct tree_entry key;
+	struct tree_entry *e;
+	git_tree *tree;
+	const git_tree_entry *entry;
+
+	git_oid_cpy(&key.tree, tree_oid);
+	key.name = name;
+
+	pthread_mutex_lock(&lock);
+	if (!tree_entries) {
+		init_arena();
+		tree_entries = hash_new(arena, tree_entry_hash, tree_entry_eq);
+	}
+	e = hash_lookup(tree_entries, &key);
+	pthread_mutex_unlock(&lock);
+	if (e)
+		return e;
+
+	if (git_tree_lookup(&tree, repo, tree_oid))
+		pfatal_git("git_tree_lookup");
+	entry = git_tree_entry_byname(tree, name);
+	if (entry) {
+		pthread_mutex_lock(&lock);
+		e = hash_lookup(tree_entries, &key);
+		if (!e) {
+			e = arena_alloc_type(arena, struct tree_entry);
+			git_oid_cpy(&e->tree, tree_oid);
+			e->name = arena_strdup(arena, name);
+			git_oid_cpy(&e->oid, git_tree_entry_id(entry));
+			e->type = git_tree_entry_type(entry);
+			hash_insert(tree_entries, e, e);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	git_tree_free(tree);
+	return e;
+}
+
+
 /* ----- Open -------------------------------------------------------------- */
 
 
-static git_repository *select_repo(const char *path)
+/*
+ * We look up the same names over and over again, once for each revision, so
+ * we remember where they led. This also remembers canonical paths, see below.
+ * Failures are not remembered, since they're usually fatal anyway.
+ *
+ * Like the repositories they lead to, these are per thread.
+ */
+
+static __thread struct arena *path_arena = NULL;
+static __thread struct hash *repos;	/* path -> git_repository */
+static __thread struct hash *canon_paths; /* path -> struct canon_path */
+static pthread_key_t path_key;
+
+
+static void free_paths(void *user)
+{
+	arena_unref(path_arena);
+	path_arena = NULL;
+}
+
+
+static void init_path_key(void)
+{
+	pthread_key_create(&path_key, free_paths);
+}
+
+
+static void init_paths(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	if (path_arena)
+		return;
+	path_arena = arena_new();
+	repos = hash_new(path_arena, hash_str, hash_str_eq);
+	canon_paths = hash_new(path_arena, hash_str, hash_str_eq);
+	pthread_once(&once, init_path_key);
+	pthread_setspecific(path_key, path_arena);
+}
+
+
+static git_repository *do_select_repo(const char *path)
 {
 	git_repository *repo = NULL;
 	char *tmp = stralloc(path);
@@ -102,6 +270,21 @@ static git_repository *select_repo(const char *path)
 }
 
 
+static git_repository *select_repo(const char *path)
+{
+	git_repository *repo;
+
+	init_paths();
+	repo = hash_lookup(repos, path);
+	if (repo)
+		return repo;
+	repo = do_select_repo(path);
+	if (repo)
+		hash_insert(repos, arena_strdup(path_arena, path), repo);
+	return repo;
+}
+
+
 static git_commit *pick_revision(git_repository *repo, const char *revision)
 {
 	git_object *obj;
@@ -274,94 +457,105 @@ static char *canonical_path_into_repo(const char *repo_dir, const char *path)
 }
 
 
-static git_tree_entry *find_file(git_repository *repo, git_tree *tree,
-    const char *path)
-{
-	git_tree_entry *entry;
-	char *repo_path = stralloc(git_repository_workdir(repo));
-		/* use workdir, not path, for submodules */
-	char *slash, *canon_path;
-	int len;
-
-	/* remove trailing / from repo_path */
-	slash = strrchr(repo_path, '/');
-	if (slash && slash != repo_path && !slash[1])
-		*slash = 0;
-
-	len = strlen(repo_path);
-	if (len >= 5 && !strcmp(repo_path + len - 5, "/.git"))
-		repo_path[len == 5 ? 1 : len - 5] = 0;
-
-	progress(2, "repo dir \"%s\"", repo_path);
-
-	canon_path = canonical_path_into_repo(repo_path, path);
-	free(repo_path);
-	if (!canon_path)
-		return NULL;
-
-	if (git_tree_entry_bypath(&entry, tree, canon_path)) {
-		perror_git(path);
-		free(canon_path);
-		return NULL;
-	}
-	free(canon_path);
+/*
+ * The canonical path of a name only depends on the file system and on the
+ * repository, so we only need to find it once per repository.
+ */
 
-	return entry;
-}
+struct canon_path {
+	const char *repo_dir;	/* from git_repo_dir */
+	const char *path;	/* path in the repository */
+	struct canon_path *next; /* same name, other repository */
+};
 
 
-static const void *get_data(struct vcs_git *vcs_git, git_tree_entry *entry,
-    unsigned *size)
+static const char *canonical_path(const char *repo_dir, const char *name)
 {
-	git_repository *repo =vcs_git->repo;
-	git_object *obj;
-	git_blob *blob;
+	struct canon_path *first, *c;
+	char *path;
 
-	if (git_tree_entry_type(entry) != GIT_OBJ_BLOB)
-		fatal("entry is not a blob\n");
-	if (git_tree_entry_to_object(&obj, repo, entry))
-		pfatal_git("git_tree_entry_to_object");
-	vcs_git->obj = obj;
+	init_paths();
+	first = hash_lookup(canon_paths, name);
+	for (c = first; c; c = c->next)
+		if (c->repo_dir == repo_dir)
+			return c->path;
 
-	if (verbose > 2) {
-		git_buf buf = { 0 };
+	path = canonical_path_into_repo(repo_dir, name);
+	if (!path)
+		return NULL;
 
-		if (git_object_short_id(&buf, obj))
-			pfatal_git("git_object_short_id");
-		progress(3, "object %s", buf.ptr);
-		git_buf_free(&buf);
+	c = arena_alloc_type(path_arena, struct canon_path);
+	c->repo_dir = repo_dir;
+	c->path = arena_strdup(path_arena, path);
+	free(path);
+	if (first) {
+		c->next = first->next;
+		first->next = c;
+	} else {
+		c->next = NULL;
+		hash_insert(canon_paths, arena_strdup(path_arena, name), c);
 	}
-	blob = (git_blob *) obj;
-	*size = git_blob_rawsize(blob);
-	return git_blob_rawcontent(blob);
+	return c->path;
 }
 
 
-static bool send_line(const char *s, unsigned len,
-    bool (*parse)(const struct file *file, void *user, const char *line),
-    void *user, const struct file *file)
+static bool find_file(git_repository *repo, git_tree *tree, const char *path,
+    git_oid *res)
 {
-	char *tmp = alloc_size(len + 1);
-	bool res;
+	const char *canon_path;
+	const struct tree_entry *e;
+	git_oid oid;
+	git_otype type = GIT_OBJ_TREE;
+	char *tmp, *name, *next;
+
+	canon_path = canonical_path(git_repo_dir(repo), path);
+	if (!canon_path)
+		return 0;
 
-	memcpy(tmp, s, len);
-	tmp[len] = 0;
-	res = parse(file, user, tmp);
+	git_oid_cpy(&oid, git_tree_id(tree));
+	tmp = stralloc(canon_path);
+	for (name = tmp; name; name = next) {
+		next = strchr(name, '/');
+		if (next)
+			*next++ = 0;
+		if (!*name)
+			continue;
+		e = type == GIT_OBJ_TREE ? tree_entry(repo, &oid, name) : NULL;
+		if (!e) {
+			error("%s: not found in tree", path);
+			free(tmp);
+			return 0;
+		}
+		git_oid_cpy(&oid, &e->oid);
+		type = e->type;
+	}
 	free(tmp);
-	return res;
+
+	if (type != GIT_OBJ_BLOB)
+		fatal("entry is not a blob\n");
+	git_oid_cpy(res, &oid);
+	return 1;
 }
 
 
+/*
+ * We only load the blob when reading the file. If a file with the same OID has
+ * already been parsed, we thus never have to load its content.
+ */
+
 static bool access_file_data(struct vcs_git *vcs_git, const char *name)
 {
-	git_tree_entry *entry;
-
-	entry = find_file(vcs_git->repo, vcs_git->tree, name);
-	if (!entry)
+	if (!find_file(vcs_git->repo, vcs_git->tree, name, &vcs_git->oid))
 		return 0;
+	vcs_git->repo_path = stralloc(git_repository_path(vcs_git->repo));
 	progress(1, "reading %s", name);
 
-	vcs_git->data = get_data(vcs_git, entry, &vcs_git->size);
+	if (verbose > 2) {
+		char buf[GIT_OID_HEXSZ + 1];
+
+		git_oid_tostr(buf, sizeof(buf), &vcs_git->oid);
+		progress(3, "object %s", buf);
+	}
 	return 1;
 }
 
@@ -480,6 +674,7 @@ struct vcs_git *vcs_git_open(const char *revision, const char *name,
 	vcs_git->name = stralloc(name);
 	vcs_git->revision = revision ? stralloc(revision) : NULL;
 	vcs_git->related = related;
+	vcs_git->repo_path = NULL;
 
 	if (try_related(vcs_git))
 		return vcs_git;
@@ -510,107 +705,165 @@ fail:
 }
 
 
-/* ----- Hash table for avoiding redundant passes through ancestry --------- */
+/* ----- Commit time ------------------------------------------------------- */
 
 
-#define	HASH_BUCKETS	257
+/*
+ * The time of a file is the author time of the earliest commit in the history
+ * of the file's revision whose tree contains the file's blob. Instead of
+ * searching the ancestry of each file separately, we index the history of
+ * each commit we're asked about once, recording the earliest time of every
+ * blob and tree we encounter. All files of that revision then share the
+ * index, and looking up a time is a single hash lookup.
+ *
+ * Each tree remembers the earliest time we've indexed it with. If we meet it
+ * again with a later time, there's nothing to update below it, so in the
+ * usual case only the trees that changed in a commit are visited.
+ *
+ * Indexes are identified by repository path and commit, so the time of a file
+ * only depends on its revision, not on which files were asked about before.
+ * Since OIDs don't depend on the repository handle, each thread indexes
+ * through its own handle. Each index has its own lock, which is held while
+ * indexing, so threads asking about the same revision wait for a single pass
+ * over its history, while other threads are not held up.
+ */
 
+struct oid_time {
+	git_oid oid;
+	time_t t;
+};
 
-static struct hash_bucket {
-	unsigned n;
-	const void **refs;
-} hash_buckets[HASH_BUCKETS];
+struct time_index {
+	const char *path;	/* repository path */
+	git_oid head;		/* commit whose history we index */
+	pthread_mutex_t lock;
+	bool indexed;		/* 0 until indexing has finished */
+	struct arena *arena;
+	struct hash *trees;	/* struct oid_time */
+	struct hash *blobs;	/* struct oid_time */
+	struct time_index *next;
+};
 
 
-static void hash_init(void)
-{
-	memset(hash_buckets, 0, sizeof(hash_buckets));
-}
+static struct time_index *time_indices = NULL;
 
 
-static bool hash_test(const void *ref)
+static struct time_index *get_time_index(git_repository *repo,
+    const git_commit *head)
 {
-	unsigned h = (unsigned long) ref % HASH_BUCKETS;
-	struct hash_bucket *b = hash_buckets + h;
-	unsigned i;
-
-	for (i = 0; i != b->n; i++)
-		if (b->refs[i] == ref)
-			return 1;
-	b->refs = realloc_type_n(b->refs, const void *, b->n + 1);
-	b->refs[b->n] = ref;
-	b->n++;
-	return 0;
+	const char *path = git_repository_path(repo);
+	const git_oid *head_oid = git_commit_id(head);
+	struct time_index *ti;
+
+	pthread_mutex_lock(&lock);
+	for (ti = time_indices; ti; ti = ti->next)
+		if (git_oid_equal(&ti->head, head_oid) &&
+		    !strcmp(ti->path, path))
+			goto out;
+
+	init_arena();
+	ti = arena_alloc_type(arena, struct time_index);
+	ti->path = arena_strdup(arena, path);
+	git_oid_cpy(&ti->head, head_oid);
+	pthread_mutex_init(&ti->lock, NULL);
+	ti->indexed = 0;
+	ti->arena = arena_new();
+	ti->trees = hash_new(ti->arena, vcs_git_oid_hash, vcs_git_oid_eq);
+	ti->blobs = hash_new(ti->arena, vcs_git_oid_hash, vcs_git_oid_eq);
+	ti->next = time_indices;
+	time_indices = ti;
+
+out:
+	pthread_mutex_unlock(&lock);
+	return ti;
 }
 
 
-static void hash_free(void)
+/*
+ * Returns 1 if the time of the object has been lowered (or if we haven't seen
+ * the object before).
+ */
+
+static bool update_time(struct time_index *ti, struct hash *hash,
+    const git_oid *oid, time_t t)
 {
-	unsigned i;
+	struct oid_time *ot;
 
-	for (i = 0; i != HASH_BUCKETS; i++)
-		free((void *) hash_buckets[i].refs);
+	ot = hash_lookup(hash, oid);
+	if (ot) {
+		if (ot->t <= t)
+			return 0;
+		ot->t = t;
+		return 1;
+	}
+	ot = arena_alloc_type(ti->arena, struct oid_time);
+	git_oid_cpy(&ot->oid, oid);
+	ot->t = t;
+	hash_insert(hash, &ot->oid, ot);
+	return 1;
 }
 
 
-/* ----- Commit time ------------------------------------------------------- */
-
-
-static int search(const char *root, const git_tree_entry *entry, void *payload)
+static void index_tree(struct time_index *ti, git_repository *repo,
+    const git_oid *tree_oid, time_t t)
 {
-	const git_oid *oid = payload;
+	git_tree *tree;
+	const git_tree_entry *entry;
+	size_t n, i;
 
-	return git_oid_equal(git_tree_entry_id(entry), oid) ? -1 : 0;
+	if (!update_time(ti, ti->trees, tree_oid, t))
+		return;
+	if (git_tree_lookup(&tree, repo, tree_oid))
+		pfatal_git("git_tree_lookup");
+	n = git_tree_entrycount(tree);
+	for (i = 0; i != n; i++) {
+		entry = git_tree_entry_byindex(tree, i);
+		switch (git_tree_entry_type(entry)) {
+		case GIT_OBJ_TREE:
+			index_tree(ti, repo, git_tree_entry_id(entry), t);
+			break;
+		case GIT_OBJ_BLOB:
+			update_time(ti, ti->blobs, git_tree_entry_id(entry), t);
+			break;
+		default:
+			break;
+		}
+	}
+	git_tree_free(tree);
 }
 
 
 /*
- * We have to use git_tree_walk instead of git_tree_entry_byid since the latter
- * doesn't recurse into sub-trees.
+ * We walk oldest first, so that most trees get their final time on the first
+ * visit.
  */
 
-static void recurse_time(const git_commit *commit, const git_oid *oid,
-    time_t *best)
+static void index_history(struct time_index *ti, git_repository *repo)
 {
-	unsigned n, i;
-	git_commit *parent;
-	git_tree *tree;
-	const git_signature *sig;
+	git_revwalk *walk;
+	git_commit *commit;
+	git_oid oid;
 	int res;
 
-	sig = git_commit_author(commit);
-#if 0
-	if (!*best || sig->when.time < *best) {
-		if (git_commit_tree(&tree, commit))
-			pfatal_git("recurse_time");
-		res = git_tree_walk(tree, GIT_TREEWALK_PRE, search,
-		    (void *) oid);
-		if (res)
-			*best = sig->when.time;
-	}
-#else
-	/*
-	 * @@@ Stopping lookups when the object in question disappears from
-	 * the tree may not be entirely correct (not sure whether it's
-	 * actually wrong, though), but it can speed up things tremendously.
-	 */
-	if (git_commit_tree(&tree, commit))
-		pfatal_git("recurse_time");
-	res = git_tree_walk(tree, GIT_TREEWALK_PRE, search,
-	    (void *) oid);
-	if (!res)
-		return;
-	if (!*best || sig->when.time < *best)
-		*best = sig->when.time;
-#endif
+	if (git_revwalk_new(&walk, repo))
+		pfatal_git("git_revwalk_new");
+	git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_REVERSE);
+	if (git_revwalk_push(walk, &ti->head))
+		pfatal_git("git_revwalk_push");
 
-	n = git_commit_parentcount(commit);
-	for (i = 0; i != n; i++) {
-		if (git_commit_parent(&parent, commit, i))
-			pfatal_git("git_commit_parent");
-		if (!hash_test(parent))
-			recurse_time(parent, oid, best);
+	while (1) {
+		res = git_revwalk_next(&oid, walk);
+		if (res == GIT_ITEROVER)
+			break;
+		if (res)
+			pfatal_git("git_revwalk_next");
+		if (git_commit_lookup(&commit, repo, &oid))
+			pfatal_git("git_commit_lookup");
+		index_tree(ti, repo, git_commit_tree_id(commit),
+		    git_commit_author(commit)->when.time);
+		git_commit_free(commit);
 	}
+	git_revwalk_free(walk);
 }
 
 
@@ -620,50 +873,83 @@ static void recurse_time(const git_commit *commit, const git_oid *oid,
 time_t vcs_git_time(void *ctx)
 {
 	const struct vcs_git *vcs_git = ctx;
-	const git_oid *oid = git_object_id(vcs_git->obj);
-	time_t t = 0;
+	struct time_index *ti;
+	const struct oid_time *ot;
 
 	/*
-	 * @@@ Retrieving time from git is rather slow, so we only do it if
-	 * there is any chance we'll actually need it.
-	 *
-	 * What would be better solutions:
-	 * - make the search more efficient (e.g., by avoiding searching the
-	 *   ancestry of merges multiple times),
-	 * - cache results,
-	 * - lazy evaluation.
+	 * Indexing the history still takes a while on the first call, so we
+	 * only do it if there is any chance we'll actually need the time.
 	 */
-	if (date_override) {
-		hash_init();
-		recurse_time(vcs_git->commit, oid, &t);
-		hash_free();
+	if (!date_override)
+		return 0;
+
+	ti = get_time_index(vcs_git->repo, vcs_git->commit);
+	pthread_mutex_lock(&ti->lock);
+	if (!ti->indexed) {
+		index_history(ti, vcs_git->repo);
+		ti->indexed = 1;
 	}
-	return t;
+	ot = hash_lookup(ti->blobs, &vcs_git->oid);
+	pthread_mutex_unlock(&ti->lock);
+	return ot ? ot->t : 0;
 }
 
 
 /* ----- Read -------------------------------------------------------------- */
 
 
+/*
+ * We tokenize a private copy of the blob in place, so reading a blob costs a
+ * single allocation regardless of the number of lines.
+ *
+ * Files may be read in a different thread than the one that opened them,
+ * e.g., by the workers of lib_parse_files. We therefore load the blob through
+ * the current thread's handle of the repository.
+ */
+
 bool vcs_git_read(void *ctx, struct file *file,
     bool (*parse)(const struct file *file, void *user, const char *line),
     void *user)
 {
-	const struct vcs_git *vcs_git = ctx;
-	const char *end = vcs_git->data + vcs_git->size;
-	const char *p = vcs_git->data;
-	const char *nl;
+	struct vcs_git *vcs_git = ctx;
+	git_repository *repo;
+	git_blob *blob;
+	unsigned size;
+	char *buf, *end, *nl;
+	char *p;
+	unsigned lines = 0;
+	bool res = 1;
+
+	if (git_repository_open_ext_caching(&repo, vcs_git->repo_path,
+	    GIT_REPOSITORY_OPEN_CROSS_FS, NULL))
+		pfatal_git(vcs_git->repo_path);
+	if (git_blob_lookup(&blob, repo, &vcs_git->oid))
+		pfatal_git(file->name);
+	size = git_blob_rawsize(blob);
+	p = buf = alloc_size(size + 1);
+	end = buf + size;
+	memcpy(buf, git_blob_rawcontent(blob), size);
+	*end = 0;
+	git_blob_free(blob);
 
 	while (p != end) {
 		nl = memchr(p, '\n', end - p);
+		if (nl)
+			*nl = 0;
+		else
+			nl = end - 1;
 		file->lineno++;
-		if (!nl)
-			return send_line(p, end - p, parse, user, file);
-		if (!send_line(p, nl - p, parse, user, file))
-			return 0;
+		lines++;
+		res = parse(file, user, p);
 		p = nl + 1;
+		if (!res)
+			break;
 	}
-	return 1;
+
+	progress(2, "%s: %u lines, %u bytes", file->name, lines,
+	    (unsigned) (p - buf));
+	free(buf);
+	return res;
 }
 
 
@@ -674,6 +960,7 @@ void vcs_git_close(void *ctx)
 {
 	struct vcs_git *vcs_git = ctx;
 
+	free((char *) vcs_git->repo_path);
 	free((char *) vcs_git->name);
 	free((char *) vcs_git->revision);
 	free(vcs_git);
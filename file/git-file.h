@@ -35,6 +35,9 @@ void vcs_git_init(void);
 
 void *vcs_git_get_oid(const void *ctx);	/* mallocs */
 bool vcs_git_oid_eq(const void *a, const void *b);
+unsigned vcs_git_oid_hash(const void *oid);
+void *vcs_git_oid_dup(const void *oid);	/* mallocs */
+char *vcs_git_oid_str(const void *oid);	/* mallocs */
 
 struct vcs_git *vcs_git_open(const char *revision, const char *name,
     const struct vcs_git *related);
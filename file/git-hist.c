@@ -14,6 +14,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include <time.h>	/* for vcs_long_for_pango */
 #include <alloca.h>
 #include <assert.h>
@@ -22,6 +23,7 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/hash.h"
 #include "file/file.h"
 #include "file/git-util.h"
 #include "file/git-file.h"
@@ -49,10 +51,12 @@ struct vcs_history {
 	unsigned n_branches;
 
 	struct vcs_hist *history;	/* any order */
+	struct hash *by_oid;		/* struct vcs_hist, by commit OID */
 
 	struct vcs_hist **sorted_hist;
 	unsigned n_hist;
 
+	struct lane *lanes;	/* thread vector */
 	unsigned max_threads;
 };
 
@@ -60,12 +64,18 @@ struct vcs_history {
 /* ----- History retrieval ------------------------------------------------- */
 
 
-static struct vcs_hist *new_commit(struct vcs_history *history, unsigned branch)
+/*
+ * If we're given a commit, we also remember it, so that find_commit can
+ * retrieve it by its OID.
+ */
+
+static struct vcs_hist *new_commit(struct vcs_history *history,
+    git_commit *commit, unsigned branch)
 {
 	struct vcs_hist *h;
 
 	h = alloc_type(struct vcs_hist);
-	h->commit = NULL;
+	h->commit = commit;
 	h->branch = branch;
 	h->branches = NULL;
 	h->n_branches = 0;
@@ -75,6 +85,8 @@ static struct vcs_hist *new_commit(struct vcs_history *history, unsigned branch)
 	h->n_older = 0;
 	h->next = history->history;
 	history->history = h;
+	if (commit)
+		hash_insert(history->by_oid, git_commit_id(commit), h);
 	return h;
 }
 
@@ -115,16 +127,19 @@ static struct branch *get_branches(git_repository *repo, unsigned *res_n)
 static const char **matching_branches(struct vcs_history *history,
     const struct git_commit *commit, unsigned *res_n)
 {
+	const git_oid *oid = git_commit_id(commit);
 	unsigned i, n = 0;
 	const char **res;
 
 	for (i = 0; i != history->n_branches; i++)
-		if (history->branches[i].commit == commit)
+		if (git_oid_equal(git_commit_id(history->branches[i].commit),
+		    oid))
 			n++;
 	res = alloc_type_n(const char *, n);
 	n = 0;
 	for (i = 0; i != history->n_branches; i++)
-		if (history->branches[i].commit == commit)
+		if (git_oid_equal(git_commit_id(history->branches[i].commit),
+		    oid))
 			res[n++] = history->branches[i].name;
 	*res_n = n;
 	return res;
@@ -139,20 +154,10 @@ static void uplink(struct vcs_hist *down, struct vcs_hist *up)
 }
 
 
-static struct vcs_hist *find_commit(struct vcs_history *history,
+static struct vcs_hist *find_commit(const struct vcs_history *history,
     const git_commit *commit)
 {
-	struct vcs_hist *h;
-
-	/*
-	 * @@@ should probably use
-	 * git_oid_equal(git_commit_id(a), git_commit_id(b))
-	 */
-
-	for (h = history->history; h; h = h->next)
-		if (h->commit == commit)
-			break;
-	return h;
+	return hash_lookup(history->by_oid, git_commit_id(commit));
 }
 
 
@@ -178,13 +183,13 @@ static void recurse(struct vcs_history *history, struct vcs_hist *h,
 			pfatal_git("git_commit_parent");
 		found = find_commit(history, commit);
 		if (found) {
+			git_commit_free(commit);
 			uplink(found, h);
 			h->older[i] = found;
 		} else {
 			struct vcs_hist *new;
 
-			new = new_commit(history, n_branches);
-			new->commit = commit;
+			new = new_commit(history, commit, n_branches);
 			new->branches = matching_branches(history, commit,
 			    &new->n_branches);
 			h->older[i] = new;
@@ -244,8 +249,7 @@ static void merge_head(struct vcs_history *history, git_commit *commit,
 
 	if (find_commit(history, commit))
 		return;
-	new = new_commit(history, 0);
-	new->commit = commit;
+	new = new_commit(history, commit, 0);
 	new->branches = matching_branches(history, new->commit,
 	    &new->n_branches);
 	recurse(history, new, 1, depth);
@@ -257,18 +261,18 @@ struct vcs_history *vcs_git_history(const char *path, unsigned depth)
 {
 	struct vcs_history *history;
 	struct vcs_hist *head, *dirty;
+	git_commit *commit;
 	git_oid oid;
 	unsigned i;
 
 	history = alloc_type(struct vcs_history);
 	history->history = NULL;
+	history->by_oid = hash_new(NULL, vcs_git_oid_hash, vcs_git_oid_eq);
 	history->heads = NULL;
 	history->n_heads = 0;
 	history->sorted_hist = NULL;
 	history->n_hist = 0;
 
-	head = new_commit(history, 0);
-
 	git_init_once();
 
 	if (git_repository_open_ext_caching(&history->repo, path,
@@ -280,15 +284,16 @@ struct vcs_history *vcs_git_history(const char *path, unsigned depth)
 	if (git_reference_name_to_id(&oid, history->repo, "HEAD"))
 		pfatal_git(git_repository_path(history->repo));
 
-	if (git_commit_lookup(&head->commit, history->repo, &oid))
+	if (git_commit_lookup(&commit, history->repo, &oid))
 		pfatal_git(git_repository_path(history->repo));
+	head = new_commit(history, commit, 0);
 
 	head->branches = matching_branches(history, head->commit,
 	    &head->n_branches);
 	recurse(history, head, 1, depth);
 
 	if (git_repo_is_dirty(history->repo)) {
-		dirty = new_commit(history, 0);
+		dirty = new_commit(history, NULL, 0);
 		dirty->older = alloc_type(struct vcs_hist *);
 		dirty->older[0] = head;
 		dirty->n_older = 1;
@@ -482,6 +487,7 @@ static void sort_history(struct vcs_history *history)
 	struct vcs_hist **vec;
 	struct vcs_hist *h;
 	unsigned n = 0;
+	unsigned i;
 
 	for (h = history->history; h; h = h->next)
 		n++;
@@ -492,6 +498,8 @@ static void sort_history(struct vcs_history *history)
 		vec[n++] = h;
 
 	qsort(vec, n, sizeof(const struct vcs_hist *), comp_hist);
+	for (i = 0; i != n; i++)
+		vec[i]->seq = i;
 
 	history->sorted_hist = vec;
 	history->n_hist = n;
@@ -501,79 +509,143 @@ static void sort_history(struct vcs_history *history)
 /* ----- Assign thread positions ------------------------------------------- */
 
 
-static void grow(const struct vcs_hist ***t, unsigned *n)
+/*
+ * Each thread leads from a commit to one of its older commits and occupies a
+ * lane (position in the thread vector) from the commit that starts it to the
+ * commit that ends it. Instead of keeping a copy of the thread vector for
+ * each commit, we record for each lane the spans it is occupied, and look up
+ * the thread vector for a given point in the history when classifying.
+ */
+
+#define	SPAN_OPEN	UINT_MAX
+
+
+struct span {
+	const struct vcs_hist *h;	/* commit starting the thread */
+	unsigned end;			/* seq of commit ending it, or SPAN_OPEN */
+};
+
+struct lane {
+	struct span *spans;	/* in history order */
+	unsigned n_spans;
+	unsigned n_alloc;
+};
+
+
+static const struct vcs_hist *holder(const struct lane *lane)
 {
-	*t = realloc_type_n(*t, const struct vcs_hist *, *n + 1);
-	(*t)[*n] = NULL;
-	(*n)++;
+	const struct span *last;
+
+	if (!lane->n_spans)
+		return NULL;
+	last = lane->spans + lane->n_spans - 1;
+	return last->end == SPAN_OPEN ? last->h : NULL;
 }
 
 
-static unsigned find_pos(const struct vcs_hist ***t, unsigned *n,
-    const struct vcs_hist *h)
+static unsigned free_lane(struct vcs_history *history)
 {
-	unsigned pos, i;
+	struct lane *lane;
+	unsigned pos;
 
-	for (pos = 0; pos != *n; pos++)
-		for (i = 0; i != h->n_newer; i++)
-			if (h->newer[i] == (*t)[pos])
-				return pos;
-	for (pos = 0; pos != *n; pos++)
-		if (!(*t)[pos])
+	for (pos = 0; pos != history->max_threads; pos++)
+		if (!holder(history->lanes + pos))
 			return pos;
-	grow(t, n);
-	return *n  - 1;
+	history->lanes = realloc_type_n(history->lanes, struct lane,
+	    history->max_threads + 1);
+	lane = history->lanes + history->max_threads;
+	lane->spans = NULL;
+	lane->n_spans = lane->n_alloc = 0;
+	return history->max_threads++;
 }
 
 
-static void clear_children(const struct vcs_hist **t, unsigned n,
+static void occupy(struct vcs_history *history, unsigned pos,
     const struct vcs_hist *h)
 {
-	unsigned i, j;
+	struct lane *lane = history->lanes + pos;
+	struct span *span;
+
+	if (lane->n_spans == lane->n_alloc) {
+		lane->n_alloc = lane->n_alloc ? lane->n_alloc * 2 : 4;
+		lane->spans = realloc_type_n(lane->spans, struct span,
+		    lane->n_alloc);
+	}
+	span = lane->spans + lane->n_spans++;
+	span->h = h;
+	span->end = SPAN_OPEN;
+}
+
+
+/*
+ * Returns the lowest lane still holding a thread from the child to its older
+ * commits, or -1 if there is none.
+ */
+
+static int child_lane(const struct vcs_history *history,
+    const struct vcs_hist *child)
+{
+	int pos = -1;
+	unsigned i;
+
+	for (i = 0; i != child->n_older; i++)
+		if (holder(history->lanes + child->lanes[i]) == child &&
+		    (pos == -1 || child->lanes[i] < (unsigned) pos))
+			pos = child->lanes[i];
+	return pos;
+}
+
+
+static unsigned find_pos(struct vcs_history *history,
+    const struct vcs_hist *h)
+{
+	int pos = -1;
+	int p;
+	unsigned i;
+
+	for (i = 0; i != h->n_newer; i++) {
+		p = child_lane(history, h->newer[i]);
+		if (p != -1 && (pos == -1 || p < pos))
+			pos = p;
+	}
+	return pos == -1 ? free_lane(history) : (unsigned) pos;
+}
+
+
+static void clear_children(struct vcs_history *history,
+    const struct vcs_hist *h)
+{
+	struct lane *lane;
+	unsigned i;
+	int pos;
 
 	for (i = 0; i != h->n_newer; i++) {
-		for (j = 0; j != n; j++)
-			if (t[j] == h->newer[i])
-				goto clear;
-		fatal("child thread not found");
-clear:
-		t[j] = NULL;
+		pos = child_lane(history, h->newer[i]);
+		if (pos == -1)
+			fatal("child thread not found");
+		lane = history->lanes + pos;
+		lane->spans[lane->n_spans - 1].end = h->seq;
 	}
 }
 
 
-static unsigned assign_threads(struct vcs_history *history)
+static void assign_threads(struct vcs_history *history)
 {
 	struct vcs_hist **h;
-	unsigned n = 0;
-	const struct vcs_hist **t = 0;
-	unsigned i, j;
+	unsigned i;
 
+	history->lanes = NULL;
+	history->max_threads = 0;
 	for (h = history->sorted_hist;
 	    h != history->sorted_hist + history->n_hist; h++) {
-		(*h)->n_threads = n;
-		(*h)->threads = alloc_type_n(const struct vcs_hist *, n);
-		memcpy((*h)->threads, t, sizeof(const struct vcs_hist *) * n);
-
-		(*h)->pos = find_pos(&t, &n, *h);
-		clear_children(t, n, *h);
+		(*h)->pos = find_pos(history, *h);
+		clear_children(history, *h);
+		(*h)->lanes = alloc_type_n(unsigned, (*h)->n_older);
 		for (i = 0; i != (*h)->n_older; i++) {
-			if (!i) {
-				t[(*h)->pos] = *h;
-				continue;
-			}
-			for (j = 0; j != n; j++)
-				if (!t[j]) {
-					t[j] = *h;
-					break;
-				}
-			if (j == n) {
-				grow(&t, &n);
-				t[n - 1] = *h;
-			}
+			(*h)->lanes[i] = i ? free_lane(history) : (*h)->pos;
+			occupy(history, (*h)->lanes[i], *h);
 		}
 	}
-	return n;
 }
 
 
@@ -586,38 +658,56 @@ unsigned threads_number(const struct vcs_history *history)
 }
 
 
+/*
+ * Returns the commit whose thread occupies the lane just before the commit
+ * with the given position in the history, or NULL if the lane is free.
+ */
+
+static const struct vcs_hist *thread_at(const struct lane *lane, unsigned seq)
+{
+	unsigned lo = 0, hi = lane->n_spans;
+	unsigned mid;
+
+	/* find the last span starting before seq */
+	while (lo != hi) {
+		mid = (lo + hi) / 2;
+		if (lane->spans[mid].h->seq < seq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo || seq > lane->spans[lo - 1].end)
+		return NULL;
+	return lane->spans[lo - 1].h;
+}
+
+
 enum thread *threads_classify(const struct vcs_history *history,
     const struct vcs_hist *h, const struct vcs_hist *next)
 {
+	const struct vcs_hist *before, *after;
 	enum thread *t;
 	unsigned i, j;
 
 	t = alloc_type_n(enum thread, history->max_threads);
-	for (i = 0; i != history->max_threads; i++)
+	for (i = 0; i != history->max_threads; i++) {
+		before = thread_at(history->lanes + i, h->seq);
+		after = next ? thread_at(history->lanes + i, next->seq) : NULL;
 		t[i] = thread_none;
-	for (i = 0; i != h->n_threads; i++)
 		for (j = 0; j != h->n_newer; j++)
-			if (h->newer[j] == h->threads[i] &&
-			    (!next || h->newer[j] != next->threads[i]))
+			if (h->newer[j] == before &&
+			    (!next || h->newer[j] != after))
 				t[i] |= thread_newer;
-	if (next) {
-		for (i = 0; i != next->n_threads; i++) {
-			if (next->threads[i] == h)
+		if (next) {
+			if (after == h)
 				t[i] |= thread_older;
-			else if (next->threads[i])
+			else if (after)
 				t[i] |= thread_other;
+		} else if (before) {
+			/* we don't have |-. type of branches */
+			assert(!(t[i] & thread_older));
+			t[i] |= thread_other;
 		}
-	} else {
-		for (i = 0; i != h->n_threads; i++)
-			if (h->threads[i]) {
-				/* we don't have |-. type of branches */
-				assert(!(t[i] & thread_older));
-				t[i] |= thread_other;
-			}
-	}
-	while (i != history->max_threads) {
-		t[i] = thread_none;
-		i++;
 	}
 	t[h->pos] |= thread_self;
 
@@ -636,7 +726,7 @@ void hist_iterate(struct vcs_history *history,
 
 	if (!history->sorted_hist) {
 		sort_history(history);
-		history->max_threads = assign_threads(history);
+		assign_threads(history);
 	}
 	for (i = 0; i != history->n_hist; i++)
 		fn(user, history->sorted_hist[i],
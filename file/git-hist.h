@@ -43,9 +43,9 @@ struct vcs_hist {
 	struct vcs_hist *next;	/* no specific order */
 	unsigned seen;		/* for traversal */
 
+	unsigned seq;		/* position in sorted history */
 	unsigned pos;		/* position in thread vector */
-	const struct vcs_hist **threads; /* previous thread members, or NULL */
-	unsigned n_threads;
+	unsigned *lanes;	/* positions of threads to older commits */
 };
 
 struct vcs_history;
@@ -17,11 +17,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <git2.h>
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
 #include "file/git-util.h"
 
 
@@ -72,37 +75,128 @@ bool git_repo_is_dirty(git_repository *repo)
 }
 
 
+/*
+ * Opening a repository is expensive, and we look up the repository of each
+ * file we open, for each revision. We therefore keep every repository we open,
+ * indexed by the directory we looked it up from, and by the path of the
+ * repository itself. Each directory thus leads to at most one open, and there
+ * is only one handle per repository.
+ *
+ * Each thread has its own handles, so that threads loading different
+ * revisions don't use the same libgit2 objects concurrently. A repository
+ * handle must therefore only be used in the thread that obtained it. The
+ * handles are closed when the thread exits.
+ */
+
+struct repo {
+	git_repository *repo;
+	const char *dir;	/* work directory, without trailing slash */
+	struct repo *next;	/* all repositories of this thread */
+};
+
+
+static __thread struct arena *repo_arena = NULL;
+static __thread struct hash *repo_by_lookup; /* directory -> struct repo */
+static __thread struct hash *repo_by_path; /* repository path -> struct repo */
+static __thread struct repo *repo_list;
+static pthread_key_t repo_key;
+
+
+static void free_repos(void *user)
+{
+	struct repo *r;
+
+	for (r = repo_list; r; r = r->next)
+		git_repository_free(r->repo);
+	arena_unref(repo_arena);
+	repo_arena = NULL;
+}
+
+
+static void init_repo_key(void)
+{
+	pthread_key_create(&repo_key, free_repos);
+}
+
+
+/*
+ * Use the work directory, not the path, for submodules.
+ */
+
+static const char *work_dir(git_repository *repo)
+{
+	char *dir = arena_strdup(repo_arena, git_repository_workdir(repo));
+	char *slash;
+	int len;
+
+	/* remove trailing / */
+	slash = strrchr(dir, '/');
+	if (slash && slash != dir && !slash[1])
+		*slash = 0;
+
+	len = strlen(dir);
+	if (len >= 5 && !strcmp(dir + len - 5, "/.git"))
+		dir[len == 5 ? 1 : len - 5] = 0;
+
+	return dir;
+}
+
+
 static int do_git_repository_open_ext_caching(git_repository **out,
     const char *path, unsigned int flags, const char *ceiling_dirs)
 {
-#if LIBGIT2_VER_MAJOR == 0 && LIBGIT2_VER_MINOR < 22
-	static struct repo_cache {
-		const char *path;
-		git_repository *repo;
-		struct repo_cache *next;
-	} *repo_cache = NULL;
-	struct repo_cache *c;
+	struct repo *r;
 	int res;
 
 	assert(flags == GIT_REPOSITORY_OPEN_CROSS_FS);
 	assert(ceiling_dirs == NULL);
-	for (c = repo_cache; c; c = c->next)
-		if (!strcmp(c->path, path)) {
-			*out = c->repo;
-			return 0;
-		}
+
+	if (!repo_arena) {
+		static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+		repo_arena = arena_new();
+		repo_by_lookup = hash_new(repo_arena, hash_str, hash_str_eq);
+		repo_by_path = hash_new(repo_arena, hash_str, hash_str_eq);
+		repo_list = NULL;
+		pthread_once(&once, init_repo_key);
+		pthread_setspecific(repo_key, repo_arena);
+	}
+
+	r = hash_lookup(repo_by_lookup, path);
+	if (r) {
+		*out = r->repo;
+		return 0;
+	}
 	res = git_repository_open_ext(out, path, flags, ceiling_dirs);
 	if (res)
 		return res;
-	c = alloc_type(struct repo_cache);
-	c->path = stralloc(path);
-	c->repo = *out;
-	c->next = repo_cache;
-	repo_cache = c;
+
+	r = hash_lookup(repo_by_path, git_repository_path(*out));
+	if (r) {
+		git_repository_free(*out);
+		*out = r->repo;
+	} else {
+		r = arena_alloc_type(repo_arena, struct repo);
+		r->repo = *out;
+		r->dir = work_dir(*out);
+		r->next = repo_list;
+		repo_list = r;
+		hash_insert(repo_by_path,
+		    arena_strdup(repo_arena, git_repository_path(*out)), r);
+		progress(2, "repo dir \"%s\"", r->dir);
+	}
+	hash_insert(repo_by_lookup, arena_strdup(repo_arena, path), r);
 	return 0;
-#else
-	return git_repository_open_ext(out, path, flags, ceiling_dirs);
-#endif
+}
+
+
+const char *git_repo_dir(git_repository *repo)
+{
+	const struct repo *r;
+
+	r = hash_lookup(repo_by_path, git_repository_path(repo));
+	assert(r);
+	return r->dir;
 }
 
 
@@ -157,19 +251,23 @@ int git_repository_open_ext_caching(git_repository **out, const char *path,
  * Git documentation says that git_libgit2_init can be called more then once
  * but doesn't quite what happens then, e.g., whether references obtained
  * before an init (except for the first, of course) can still be used after
- * it. So we play it safe and initialize only once.
+ * it. So we play it safe and initialize only once, even if files are opened
+ * from several threads.
  */
 
-void git_init_once(void)
+static void git_init(void)
 {
-	static bool initialized = 0;
-
-	if (!initialized) {
 #if LIBGIT2_VER_MAJOR == 0 && LIBGIT2_VER_MINOR < 22
-		git_threads_init();
+	git_threads_init();
 #else
-		git_libgit2_init();
+	git_libgit2_init();
 #endif
-		initialized = 1;
-	}
+}
+
+
+void git_init_once(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, git_init);
 }
@@ -21,6 +21,13 @@
 int git_repository_open_ext_caching(git_repository **out, const char *path, 
     unsigned int flags, const char *ceiling_dirs);
 
+/*
+ * Work directory of a repository opened with git_repository_open_ext_caching,
+ * without trailing slash.
+ */
+
+const char *git_repo_dir(git_repository *repo);
+
 bool git_repo_is_dirty(git_repository *repo);
 void git_init_once(void);
 
@@ -161,6 +161,8 @@ void *diff_process_file(struct diff *diff, struct file_names *file_names,
 	struct file sch_file;
 	struct sch_ctx sch;
 	struct lib lib;
+	struct file *lib_files = NULL;
+	unsigned libs_open = 0;
 	unsigned i;
 
 	sch_init(&sch, 0);
@@ -179,11 +181,19 @@ void *diff_process_file(struct diff *diff, struct file_names *file_names,
 
 	if (!file_open(&sch_file, fn->sch, file_names->pro ? &pro_file : NULL))
 		goto fail_open;
-	for (i = 0 ; i != fn->n_libs; i++)
-		if (!lib_parse_search(&lib, fn->libs[i], fn, &sch_file))
+
+	lib_files = alloc_type_n(struct file, fn->n_libs);
+	for (libs_open = 0; libs_open != fn->n_libs; libs_open++)
+		if (!lib_find_file(lib_files + libs_open, fn->libs[libs_open],
+		    fn, &sch_file))
 			goto fail_parse;
-	if (!sch_parse(&sch, &sch_file, &lib, NULL))
+	if (!lib_parse_files(&lib, lib_files, libs_open))
+		goto fail_parse;
+	if (!sch_parse(&sch, &sch_file, &lib))
 		goto fail_parse;
+	for (i = 0; i != libs_open; i++)
+		file_close(lib_files + i);
+	free(lib_files);
 	file_close(&sch_file);
 	if (file_names->pro)
 		file_close(&pro_file);
@@ -206,6 +216,9 @@ void *diff_process_file(struct diff *diff, struct file_names *file_names,
 	return diff->gfx;
 
 fail_parse:
+	while (libs_open--)
+		file_close(lib_files + libs_open);
+	free(lib_files);
 	file_close(&sch_file);
 fail_open:
 	sch_free(&sch);
@@ -64,8 +64,6 @@ struct gui_hist {
 	struct pl_ctx *pl;	/* NULL if none or failed */
 
 	/* caching support */
-	void **oids;		/* file object IDs */
-	unsigned libs_open;
 	struct sch_ctx sch_ctx;
 	struct lib lib;		/* combined library */
 	bool identical;		/* identical with previous entry */
@@ -135,8 +133,7 @@ struct gui {
 
 	/* progress bar */
 	int hist_size;		/* total number of revisions */
-	unsigned progress;	/* progress counter */
-	unsigned progress_scale;/* right-shift by this value */
+	unsigned progress;	/* revisions loaded so far */
 };
 
 
@@ -148,7 +145,7 @@ struct gui {
 
 /* progress.c */
 
-void setup_progress_bar(struct gui *gui, GtkWidget *window);
+void progress_draw_event(const struct gui *gui, cairo_t *cr);
 void progress_update(struct gui *gui);
 
 /* render.c */
@@ -183,6 +180,7 @@ void view_full_commit(struct gui *gui);
 void commit_hover(struct gui *gui, const struct vcs_hist *vcs_hist);
 void history_draw_event(const struct gui *gui, cairo_t *cr);
 void show_history(struct gui *gui, enum selecting sel);
+void history_grow(struct gui *gui, struct gui_hist *last);
 
 /* index.c */
 
@@ -40,7 +40,7 @@ struct comp_aoi_ctx {
 	const struct sch_obj *obj;
 	struct dwg_bbox bbox;
 	struct overlay *over;
-	const char *ref;
+	char *ref;
 	const char *doc;		/* may be NULL */
 	struct comp_pop_item *items;
 };
@@ -77,7 +77,8 @@ static void bbox_add_circ(int x, int y, int r,
 }
 
 
-static struct dwg_bbox get_bbox(const struct sch_obj *sch_obj)
+static struct dwg_bbox get_bbox(const struct comp *comp,
+    const struct sch_obj *sch_obj)
 {
 	const struct lib_obj *obj;
 	int xa = 0, ya = 0, xb = 0, yb = 0;
@@ -86,7 +87,7 @@ static struct dwg_bbox get_bbox(const struct sch_obj *sch_obj)
 	struct dwg_bbox bbox;
 	const int *m = sch_obj->u.comp.m;
 
-	for (obj = sch_obj->u.comp.comp->objs; obj; obj = obj->next) {
+	for (obj = comp->objs; obj; obj = obj->next) {
 		if (obj->unit && sch_obj->u.comp.unit != obj->unit)
 			continue;
 		switch (obj->type) {
@@ -212,12 +213,13 @@ void add_comp_aoi(struct gui_sheet *sheet, const struct sch_obj *obj)
 {
 	struct dwg_bbox bbox;
 	struct comp_aoi_ctx *ctx = alloc_type(struct comp_aoi_ctx);
+	const struct comp *comp = sch_find_comp(sheet->sch, &obj->u.comp);
 	const struct comp_field *f;
 
-	if (!obj->u.comp.comp)
+	if (!comp)
 		return;
 
-	bbox = get_bbox(obj);
+	bbox = get_bbox(comp, obj);
 
 	struct aoi cfg = {
 		.x	= bbox.x,
@@ -243,7 +245,8 @@ void add_comp_aoi(struct gui_sheet *sheet, const struct sch_obj *obj)
 				free(ctx);
 				return;
 			}
-			ctx->ref = f->txt.s;
+			ctx->ref = sch_comp_ref(sheet->sch, &obj->u.comp,
+			    f->txt.s);
 			break;
 		case 3:
 			if (strcmp(f->txt.s, "~"))
@@ -55,7 +55,7 @@ static void add_dest_overlay(struct gui *gui, const char *label,
 	for (obj = sheet->sch->objs; obj; obj = obj->next) {
 		if (obj->type != sch_obj_glabel)
 			continue;
-		if (strcmp(obj->u.text.s, label))
+		if (obj->u.text.s != label)
 			continue;
 		add_pop_item(gui, glabel_dest_click, sheet, GLABEL_W,
 		    sheet == gui->curr_sheet, "%d %s", n,
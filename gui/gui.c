@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <gdk/gdkx.h>
 #include <gtk/gtk.h>
@@ -29,6 +30,7 @@
 #include "version.h"
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/pool.h"
 #include "file/git-hist.h"
 #include "kicad/ext.h"
 #include "kicad/pl.h"
@@ -36,6 +38,7 @@
 #include "kicad/sch.h"
 #include "kicad/pro.h"
 #include "kicad/delta.h"
+#include "kicad/cache.h"
 #include "gui/aoi.h"
 #include "gui/input.h"
 #include "gui/common.h"
@@ -65,8 +68,7 @@ struct gui_sheet *find_corresponding_sheet(struct gui_sheet *pick_from,
 
 	if (title)
 		for (sheet = pick_from; sheet; sheet = sheet->next)
-			if (sheet->sch->title &&
-			    !strcmp(title, sheet->sch->title))
+			if (sheet->sch->title == title)
 				return sheet;
 
 	/* plan B: use sheet in same position in sheet sequence */
@@ -209,45 +211,44 @@ static struct gui_sheet *get_sheets(struct gui *gui, struct gui_hist *hist,
 /*
  * Library caching:
  *
- * We reuse previous components if all libraries are identical
+ * We reuse the combined library of any revision we've already loaded if all
+ * libraries are identical. Libraries are looked up in the process-wide cache
+ * (kicad/cache.c), by the object IDs (hashes) of all the library files.
+ *
+ * Otherwise, lib_parse_files only parses the library files that have changed
+ * and shares the others.
  *
  * Future optimizations:
- * - don't parse into single list of components, so that we can share
- *   libraries that are the same, even if there are others that have changed.
  * - maybe put components into tree, so that they can be replaced individually
  *   (this would also help to identify sheets that don't need parsing)
  *
  * Sheet caching:
  *
- * We reuse previous sheets if
- * - all libraries are identical (whether a given sheet uses them or not),
+ * We reuse sheets of any revision we've already loaded if
  * - they have no sub-sheets, and
  * - the objects IDs (hashes) are identical.
  *
- * Note that we only compare with the immediately preceding (newer) revision,
- * so branches and merges can disrupt caching.
+ * Components are only looked up in the library when a sheet is rendered or
+ * compared, so library changes don't affect sheet caching. When comparing
+ * revisions, only the components a sheet actually uses are looked up.
+ *
+ * Since the cache is global, branches and merges don't disrupt caching, and
+ * it doesn't matter in which order revisions are parsed.
  *
  * Possible optimizations:
  * - if we record which child sheets a sheet has, we could also clone it,
  *   without having to parse it. However, this is somewhat complex and may
  *   not save all that much time.
- * - we could record what libraries a sheet uses, and parse only if one of
- *   these has changed (benefits scenarios with many library files),
- * - we could record what components a sheet uses, and parse only if one of
- *   these has changed (benefits scenarios with few big libraries),
- * - we could postpone library lookups to render time.
- * - we could record IDs globally, which would help to avoid tripping over
- *   branches and merges.
  */
 
 static const struct sheet *parse_files(struct gui_hist *hist,
-    const struct file_names *fn, bool recurse, struct gui_hist *prev)
+    const struct file_names *fn, bool recurse)
 {
 	char *rev = NULL;
 	struct file pro_file, sch_file;
 	const struct file *leader = NULL;
 	unsigned libs_open, i;
-	bool libs_cached = 0;
+	const struct lib *cached;
 	bool ok;
 
 	if (hist->vcs_hist && hist->vcs_hist->commit)
@@ -284,7 +285,8 @@ static const struct sheet *parse_files(struct gui_hist *hist,
 	if (!leader)
 		leader = &sch_file;
 
-	struct file lib_files[fn->n_libs];
+	struct file lib_files[fn->n_libs ? fn->n_libs : 1];
+	void *oids[fn->n_libs ? fn->n_libs : 1];
 
 	lib_init(&hist->lib);
 	libs_open = 0;
@@ -299,29 +301,23 @@ static const struct sheet *parse_files(struct gui_hist *hist,
 	 * failure and don't reject the revision just because of it.
 	 */
 
-	if (hist->vcs_hist) {
-		hist->oids = alloc_type_n(void *, libs_open);
-		hist->libs_open = libs_open;
-		for (i = 0; i != libs_open; i++)
-			hist->oids[i] = file_oid(lib_files + i);
-		if (prev && prev->vcs_hist && prev->libs_open == libs_open) {
-			for (i = 0; i != libs_open; i++)
-				if (!file_oid_eq(hist->oids[i], prev->oids[i]))
-					break;
-			if (i == libs_open) {
-				hist->lib.comps = prev->lib.comps;
-				libs_cached = 1;
-			}
-		}
+	for (i = 0; i != libs_open; i++)
+		oids[i] = file_oid(lib_files + i);
+	cached = cache_lib(oids, libs_open);
+	if (cached) {
+		lib_share(&hist->lib, cached);
+		ok = 1;
+	} else {
+		ok = lib_parse_files(&hist->lib, lib_files, libs_open);
+		if (ok)
+			cache_add_lib(oids, libs_open, &hist->lib);
 	}
+	for (i = 0; i != libs_open; i++)
+		free(oids[i]);
+	if (!ok)
+		goto fail;
 
-	if (!libs_cached)
-		for (i = 0; i != libs_open; i++)
-			if (!lib_parse_file(&hist->lib, lib_files +i))
-				goto fail;
-
-	if (!sch_parse(&hist->sch_ctx, &sch_file, &hist->lib,
-	    libs_cached ? &prev->sch_ctx : NULL))
+	if (!sch_parse(&hist->sch_ctx, &sch_file, &hist->lib))
 		goto fail;
 
 	for (i = 0; i != libs_open; i++)
@@ -329,22 +325,6 @@ static const struct sheet *parse_files(struct gui_hist *hist,
 	file_close(&sch_file);
 	// @@@ close pro_file
 
-	/*
-	 * sheet_eq recurses into sub-sheets, so we compare all sheets, even if
-	 * it may look like it.
-	 */
-
-	if (prev && prev->sheets &&
-	    sheet_eq(prev->sch_ctx.sheets, hist->sch_ctx.sheets, 1))
-		prev->identical = 1;
-
-	/*
-	 * @@@ we have a major memory leak for the component library.
-	 * We should record parsed schematics and libraries separately, so
-	 * that we can clean them up, without having to rely on the history,
-	 * with - when sharing unchanged item - possibly many duplicate
-	 * pointers.
-	 */
 	return hist->sch_ctx.sheets;
 
 fail:
@@ -358,70 +338,310 @@ fail:
 }
 
 
-struct add_hist_ctx {
+/*
+ * Revisions are parsed in the background, by a loader thread that hands them
+ * to a pool of workers. Each worker opens its own repository handles. Results
+ * are added to the history in history order by the main thread, from an idle
+ * callback, which also updates the progress bar and marks revisions that are
+ * identical with their predecessor.
+ */
+
+struct load_ctx {
 	struct gui *gui;
 	const struct file_names *fn;
 	bool recurse;
-	unsigned limit;
+	int limit;
+
+	pthread_t thread;		/* loader */
+	pthread_mutex_t mutex;
+	pthread_cond_t done;		/* a revision has been parsed */
+	bool cancel;			/* don't parse any more revisions */
+	guint idle;			/* idle callback; 0 if none pending */
+
+	struct load_job *jobs;		/* in history order */
+	struct load_job **next_job;
+	struct load_job *next_done;	/* next job to add to history */
+	struct gui_hist *last;		/* last revision added */
+	unsigned age;
 };
 
+struct load_job {
+	struct load_ctx *ctx;
+	struct gui_hist *hist;
+	const struct sheet *sch;	/* NULL if parsing failed */
+	bool done;
+	struct load_job *next;
+};
 
-static void add_hist(void *user, struct vcs_hist *h,
-    const struct vcs_hist *next)
-{
-	struct add_hist_ctx *ahc = user;
-	struct gui *gui = ahc->gui;
-	struct gui_hist **anchor, *hist, *prev;
-	const struct sheet *sch;
-	unsigned age = 0;
 
-	if (!ahc->limit)
-		return;
-	if (ahc->limit > 0)
-		ahc->limit--;
+static gboolean loaded(gpointer user);
 
-	prev = NULL;
-	for (anchor = &gui->hist; *anchor; anchor = &(*anchor)->next) {
-		prev = *anchor;
-		age++;
+
+static void load_job(void *user)
+{
+	struct load_job *job = user;
+	struct load_ctx *ctx = job->ctx;
+	struct vcs_hist *h = job->hist->vcs_hist;
+	char *rev = h && h->commit ? vcs_git_get_rev(h) : NULL;
+	bool cancel;
+
+	pthread_mutex_lock(&ctx->mutex);
+	cancel = ctx->cancel;
+	pthread_mutex_unlock(&ctx->mutex);
+
+	if (!cancel) {
+		progress(1, "processing revision %s",
+		    rev ? rev : "(uncommitted)");
+		job->sch = parse_files(job->hist, ctx->fn, ctx->recurse);
 	}
+	free(rev);
+
+	pthread_mutex_lock(&ctx->mutex);
+	job->done = 1;
+	pthread_cond_signal(&ctx->done);
+	if (!ctx->idle)
+		ctx->idle = g_idle_add(loaded, ctx);
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+
+static void *loader(void *user)
+{
+	struct load_ctx *ctx = user;
+	struct pool *pool = pool_new(jobs);
+	struct load_job *job;
+
+	for (job = ctx->jobs; job; job = job->next)
+		pool_add(pool, load_job, job);
+	pool_wait(pool);
+	pool_free(pool);
+	return NULL;
+}
+
+
+/*
+ * sheet_eq recurses into sub-sheets, so we compare all sheets, even if it may
+ * look like it.
+ */
+
+static void add_hist(struct load_ctx *ctx, struct load_job *job)
+{
+	struct gui *gui = ctx->gui;
+	struct gui_hist *hist = job->hist;
+	struct gui_hist *prev = ctx->last;
+
+	hist->sheets = job->sch ? get_sheets(gui, hist, job->sch) : NULL;
+	hist->age = ctx->age++;
+	if (prev && prev->sheets && job->sch &&
+	    sheet_eq(prev->sch_ctx.sheets, hist->sch_ctx.sheets, 1))
+		prev->identical = 1;
+
+	if (prev)
+		prev->next = hist;
+	else
+		gui->hist = hist;
+	ctx->last = hist;
+
+	progress_update(gui);
+}
+
 
-	/* @@@ should free the string returned by vcs_git_get_rev */
-	progress(1, "processing revision %s",
-	    h && h->commit ? vcs_git_get_rev(h) : "(uncommitted)");
+/*
+ * Adds the next revision to the history. If "wait" is set, we wait until it
+ * has been parsed. Returns 0 if there is no revision left to add or if it
+ * hasn't been parsed yet.
+ */
+
+static bool add_next(struct load_ctx *ctx, bool wait)
+{
+	struct load_job *job = ctx->next_done;
+	bool done;
+
+	if (!job)
+		return 0;
+
+	pthread_mutex_lock(&ctx->mutex);
+	while (wait && !job->done)
+		pthread_cond_wait(&ctx->done, &ctx->mutex);
+	done = job->done;
+	pthread_mutex_unlock(&ctx->mutex);
+	if (!done)
+		return 0;
+
+	add_hist(ctx, job);
+	ctx->next_done = job->next;
+	return 1;
+}
+
+
+/*
+ * Adding a revision compares its sheets with the previous revision, which can
+ * take a while. We therefore add only one revision per call, so that the GUI
+ * stays responsive, and stay scheduled as long as the next revision is ready.
+ * Otherwise, the next job to finish schedules us again.
+ */
+
+static gboolean loaded(gpointer user)
+{
+	struct load_ctx *ctx = user;
+	struct gui_hist *last = ctx->last;
+	const struct load_job *job = ctx->next_done;
+	bool ready;
+
+	pthread_mutex_lock(&ctx->mutex);
+	ready = job && job->done;
+	if (!ready)
+		ctx->idle = 0;
+	pthread_mutex_unlock(&ctx->mutex);
+	if (!ready)
+		return FALSE;
+
+	add_next(ctx, 0);
+	if (last)
+		history_grow(ctx->gui, last);
+	return TRUE;
+}
+
+
+static void submit_hist(void *user, struct vcs_hist *h,
+    const struct vcs_hist *next)
+{
+	struct load_ctx *ctx = user;
+	struct load_job *job;
+	struct gui_hist *hist;
+
+	if (!ctx->limit)
+		return;
+	if (ctx->limit > 0)
+		ctx->limit--;
 
 	hist = alloc_type(struct gui_hist);
-	hist->gui = gui;
+	hist->gui = ctx->gui;
 	hist->vcs_hist = h;
-	hist->libs_open = 0;
 	hist->identical = 0;
 	hist->pl = NULL;
-	sch = parse_files(hist, ahc->fn, ahc->recurse, prev);
-	hist->sheets = sch ? get_sheets(gui, hist, sch) : NULL;
-	hist->age = age;
-
 	hist->next = NULL;
-	*anchor = hist;
 
-	if (gui->hist_size)
-		progress_update(gui);
+	job = alloc_type(struct load_job);
+	job->ctx = ctx;
+	job->hist = hist;
+	job->sch = NULL;
+	job->done = 0;
+	job->next = NULL;
+	*ctx->next_job = job;
+	ctx->next_job = &job->next;
+	if (!ctx->next_done)
+		ctx->next_done = job;
 }
 
 
-static void get_revisions(struct gui *gui, const struct file_names *fn,
-    bool recurse, int limit)
+/*
+ * Starts loading the revisions and returns as soon as the first revision that
+ * can be shown is available.
+ */
+
+static struct load_ctx *get_revisions(struct gui *gui,
+    const struct file_names *fn, bool recurse, int limit)
 {
-	struct add_hist_ctx add_hist_ctx = {
-		.gui		= gui,
-		.fn		= fn,
-		.recurse	= recurse,
-		.limit		= limit ? limit < 0 ? -limit : limit : -1,
-	};
+	struct load_ctx *ctx = alloc_type(struct load_ctx);
+	int err;
+
+	ctx->gui = gui;
+	ctx->fn = fn;
+	ctx->recurse = recurse;
+	ctx->limit = limit ? limit < 0 ? -limit : limit : -1;
+	ctx->cancel = 0;
+	ctx->idle = 0;
+	ctx->jobs = NULL;
+	ctx->next_job = &ctx->jobs;
+	ctx->next_done = NULL;
+	ctx->last = NULL;
+	ctx->age = 0;
 
 	if (gui->vcs_history)
-		hist_iterate(gui->vcs_history, add_hist, &add_hist_ctx);
+		hist_iterate(gui->vcs_history, submit_hist, ctx);
 	else
-		add_hist(&add_hist_ctx, NULL, NULL);
+		submit_hist(ctx, NULL, NULL);
+
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_cond_init(&ctx->done, NULL);
+	err = pthread_create(&ctx->thread, NULL, loader, ctx);
+	if (err)
+		fatal("pthread_create: %s", strerror(err));
+
+	while (!gui->new_hist) {
+		if (!add_next(ctx, 1))
+			fatal("no valid sheets\n");
+		if (ctx->last->sheets)
+			gui->new_hist = ctx->last;
+	}
+	return ctx;
+}
+
+
+/*
+ * Waits for the loader to finish. If "cancel" is set, revisions that have not
+ * been parsed yet are skipped, and revisions not yet in the history are
+ * discarded. This is for when the GUI is already gone.
+ */
+
+static void end_revisions(struct load_ctx *ctx, bool cancel)
+{
+	struct load_job *job, *next;
+
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->cancel = cancel;
+	pthread_mutex_unlock(&ctx->mutex);
+
+	pthread_join(ctx->thread, NULL);
+	if (ctx->idle)
+		g_source_remove(ctx->idle);
+
+	if (!cancel)
+		while (add_next(ctx, 0));
+	for (job = ctx->next_done; job; job = job->next) {
+		if (job->sch) {
+			sch_free(&job->hist->sch_ctx);
+			lib_free(&job->hist->lib);
+		}
+		if (job->hist->pl)
+			pl_free(job->hist->pl);
+		free(job->hist);
+	}
+
+	pthread_cond_destroy(&ctx->done);
+	pthread_mutex_destroy(&ctx->mutex);
+	for (job = ctx->jobs; job; job = next) {
+		next = job->next;
+		free(job);
+	}
+	free(ctx);
+}
+
+
+/*
+ * Since libraries and schematics shared between revisions are reference
+ * counted, we can free each revision on its own.
+ *
+ * @@@ we don't free the GUI's per-sheet data yet.
+ */
+
+static void free_revisions(struct gui *gui)
+{
+	struct gui_hist *next;
+
+	while (gui->hist) {
+		next = gui->hist->next;
+		if (gui->hist->sheets) {
+			sch_free(&gui->hist->sch_ctx);
+			lib_free(&gui->hist->lib);
+		}
+		if (gui->hist->pl)
+			pl_free(gui->hist->pl);
+		free(gui->hist);
+		gui->hist = next;
+	}
+	cache_free();
 }
 
 
@@ -494,7 +714,9 @@ int run_gui(const struct file_names *fn, bool recurse, int limit,
 		.hist_y_offset	= 0,
 		.commit_hover	= NULL,
 		.hist_size	= 0,
+		.progress	= 0,
 	};
+	struct load_ctx *load;
 
 	window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 	gui.da = gtk_drawing_area_new();
@@ -512,14 +734,7 @@ int run_gui(const struct file_names *fn, bool recurse, int limit,
 	gtk_widget_show_all(window);
 
 	get_history(&gui, fn->pro ? fn->pro : fn->sch, limit);
-	if (gui.hist_size)
-		setup_progress_bar(&gui, window);
-
-	get_revisions(&gui, fn, recurse, limit);
-	for (gui.new_hist = gui.hist; gui.new_hist && !gui.new_hist->sheets;
-	    gui.new_hist = gui.new_hist->next);
-	if (!gui.new_hist)
-		fatal("no valid sheets\n");
+	load = get_revisions(&gui, fn, recurse, limit);
 
 	g_signal_connect(G_OBJECT(gui.da), "size_allocate",
 	    G_CALLBACK(size_allocate_event), &gui);
@@ -561,5 +776,8 @@ int run_gui(const struct file_names *fn, bool recurse, int limit,
 	if (limit >= 0)
 		gtk_main();
 
+	end_revisions(load, limit >= 0);
+	free_revisions(&gui);
+
 	return 0;
 }
@@ -515,6 +515,16 @@ static const struct input_ops history_input_ops = {
 /* ----- Invocation -------------------------------------------------------- */
 
 
+static void add_history(struct gui *gui, struct gui_hist *h)
+{
+	h->over = overlay_add(&gui->hist_overlays, &gui->aois,
+	    hover_history, click_history, h);
+	h->skipped = 0;
+	set_history_style(h, 0);
+	hover_history(h, 0, 0, 0);
+}
+
+
 void show_history(struct gui *gui, enum selecting sel)
 {
 	struct gui_hist *h = gui->hist;
@@ -527,11 +537,28 @@ void show_history(struct gui *gui, enum selecting sel)
 	overlay_remove_all(&gui->hist_overlays);
 	for (h = gui->hist; h; h = h->next) {
 		h = skip_history(gui, h);
-		h->over = overlay_add(&gui->hist_overlays, &gui->aois,
-		    hover_history, click_history, h);
-		h->skipped = 0;
-		set_history_style(h, 0);
-		hover_history(h, 0, 0, 0);
+		add_history(gui, h);
 	}
 	redraw(gui);
 }
+
+
+/*
+ * Revisions that are loaded while the history is shown are added at the end
+ * of the list. "last" is the last revision that was already listed. Since it
+ * may have turned out to be identical with its successor, we update its
+ * style. Commits without changes are only combined when the history is
+ * opened again.
+ */
+
+void history_grow(struct gui *gui, struct gui_hist *last)
+{
+	struct gui_hist *h;
+
+	if (gui->mode != showing_history)
+		return;
+	set_history_style(last, 0);
+	for (h = last->next; h; h = h->next)
+		add_history(gui, h);
+	redraw(gui);
+}
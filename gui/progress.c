@@ -29,37 +29,38 @@
 #include "gui/common.h"
 
 
-#define	PROGRESS_BAR_HEIGHT	10
+#define	PROGRESS_BAR_HEIGHT	4
+#define	PROGRESS_BAR_MARGIN	5
 
 
-static void progress_draw_event(GtkWidget *widget, cairo_t *cr,
-    gpointer user_data)
+/*
+ * While older revisions are still being loaded, we show a thin progress bar
+ * at the bottom of the window, on top of whatever else is displayed.
+ */
+
+void progress_draw_event(const struct gui *gui, cairo_t *cr)
 {
 	GtkAllocation alloc;
-	struct gui *gui = user_data;
 	unsigned w, x;
 
-	x = gui->progress >> gui->progress_scale;
-	if (!x) {
-		/* @@@ needed ? Gtk seems to always clear the the surface. */
-		cairo_set_source_rgb(cr, 1, 1, 1);
-		cairo_paint(cr);
-	}
+	if (gui->progress >= (unsigned) gui->hist_size)
+		return;
 
 	gtk_widget_get_allocation(gui->da, &alloc);
-	w = gui->hist_size >> gui->progress_scale;
+	w = alloc.width / 3;
+	x = (unsigned long) w * gui->progress / gui->hist_size;
 
 	cairo_save(cr);
-	cairo_translate(cr,
-	    (alloc.width - w) / 2, (alloc.height - PROGRESS_BAR_HEIGHT) / 2);
+	cairo_translate(cr, (alloc.width - w) / 2,
+	    alloc.height - PROGRESS_BAR_HEIGHT - PROGRESS_BAR_MARGIN);
 
 	cairo_set_source_rgb(cr, 0, 0.7, 0);
 	cairo_set_line_width(cr, 0);
 	cairo_rectangle(cr, 0, 0, x, PROGRESS_BAR_HEIGHT);
 	cairo_fill(cr);
 
-	cairo_set_source_rgb(cr, 0, 0, 0);
-	cairo_set_line_width(cr, 2);
+	cairo_set_source_rgba(cr, 0, 0, 0, 0.5);
+	cairo_set_line_width(cr, 1);
 	cairo_rectangle(cr, 0, 0, w, PROGRESS_BAR_HEIGHT);
 	cairo_stroke(cr);
 
@@ -67,33 +68,17 @@ static void progress_draw_event(GtkWidget *widget, cairo_t *cr,
 }
 
 
-void setup_progress_bar(struct gui *gui, GtkWidget *window)
-{
-	GtkAllocation alloc;
-
-	gtk_widget_get_allocation(gui->da, &alloc);
-
-	gui->progress_scale = 0;
-	while ((gui->hist_size >> gui->progress_scale) > alloc.width)
-		gui->progress_scale++;
-	gui->progress = 0;
-
-	g_signal_connect(G_OBJECT(gui->da), "draw",
-	    G_CALLBACK(progress_draw_event), gui);
-
-	redraw(gui);
-	gtk_main_iteration_do(0);
-}
-
+/*
+ * Only the progress bar needs redrawing, not the sheet below it.
+ */
 
 void progress_update(struct gui *gui)
 {
-	unsigned mask = (1 << gui->progress_scale) - 1;
+	GtkAllocation alloc;
 
 	gui->progress++;
-	if ((gui->progress & mask) != mask)
-		return;
-
-	redraw(gui);
-	gtk_main_iteration_do(0);
+	gtk_widget_get_allocation(gui->da, &alloc);
+	gtk_widget_queue_draw_area(gui->da, 0,
+	    alloc.height - PROGRESS_BAR_HEIGHT - 2 * PROGRESS_BAR_MARGIN,
+	    alloc.width, PROGRESS_BAR_HEIGHT + 2 * PROGRESS_BAR_MARGIN);
 }
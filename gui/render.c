@@ -93,7 +93,7 @@ static void highlight_glabel(const struct gui *gui,
 
 		if (obj->type != sch_obj_glabel)
 			continue;
-		if (strcmp(obj->u.text.s, gui->glabel))
+		if (obj->u.text.s != gui->glabel)
 			continue;
 
 		cairo_rectangle(cr,
@@ -232,6 +232,7 @@ static gboolean on_draw_event(GtkWidget *widget, cairo_t *cr,
 		break;
 	}
 
+	progress_draw_event(gui, cr);
 	timer_show(cr);
 
 	return FALSE;
@@ -0,0 +1,294 @@
+/*
+ * kicad/cache.c - Process-wide cache of parsed sheets and libraries
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "misc/util.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
+#include "file/file.h"
+#include "kicad/lib.h"
+#include "kicad/sch.h"
+#include "kicad/cache.h"
+
+
+struct sheet_entry {
+	struct sheet sheet;		/* our copy; objs_arena is our
+					   reference */
+	struct sheet_entry *next;
+};
+
+struct lib_entry {
+	void **oids;
+	unsigned n;
+	struct lib lib;			/* shares the original library */
+	struct lib_entry *next;
+};
+
+struct unit_entry {
+	void *oid;
+	const struct lib *unit;		/* we hold a reference on its arena */
+	struct unit_entry *next;
+};
+
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct arena *arena;
+static struct hash *sheets;
+static struct hash *libs;
+static struct hash *units;
+static struct sheet_entry *sheet_list;
+static struct lib_entry *lib_list;
+static struct unit_entry *unit_list;
+
+
+static void cache_init(void)
+{
+	if (arena)
+		return;
+	arena = arena_new();
+}
+
+
+/* ----- Sheets ------------------------------------------------------------ */
+
+
+static const struct sheet *find_sheet(const void *oid)
+{
+	if (!oid || !sheets)
+		return NULL;
+	return hash_lookup(sheets, oid);
+}
+
+
+const struct sheet *cache_sheet(const void *oid)
+{
+	const struct sheet *sheet;
+
+	pthread_mutex_lock(&lock);
+	sheet = find_sheet(oid);
+	pthread_mutex_unlock(&lock);
+	return sheet;
+}
+
+
+/*
+ * "sheet_arena" must contain the sheet and its objects.
+ */
+
+void cache_add_sheet(const struct sheet *sheet, struct arena *sheet_arena)
+{
+	struct sheet_entry *e;
+
+	if (!sheet->oid)
+		return;
+	pthread_mutex_lock(&lock);
+	if (find_sheet(sheet->oid))
+		goto out;
+	cache_init();
+	if (!sheets)
+		sheets = hash_new(arena, file_oid_hash, file_oid_eq);
+
+	e = arena_alloc_type(arena, struct sheet_entry);
+	e->sheet = *sheet;
+	e->sheet.oid = file_oid_dup(sheet->oid);
+	e->sheet.objs_arena = arena_ref(sheet_arena);
+	e->sheet.next_obj = NULL;
+	e->sheet.next = NULL;
+	e->sheet.lib = NULL;
+	e->sheet.comps = NULL;
+	e->next = sheet_list;
+	sheet_list = e;
+	hash_insert(sheets, e->sheet.oid, &e->sheet);
+out:
+	pthread_mutex_unlock(&lock);
+}
+
+
+/* ----- Libraries --------------------------------------------------------- */
+
+
+static unsigned lib_hash(const void *key)
+{
+	const struct lib_entry *e = key;
+	unsigned h = e->n;
+	unsigned i;
+
+	for (i = 0; i != e->n; i++)
+		h = h * 31 + file_oid_hash(e->oids[i]);
+	return h;
+}
+
+
+static bool lib_eq(const void *a, const void *b)
+{
+	const struct lib_entry *ea = a;
+	const struct lib_entry *eb = b;
+	unsigned i;
+
+	if (ea->n != eb->n)
+		return 0;
+	for (i = 0; i != ea->n; i++)
+		if (!file_oid_eq(ea->oids[i], eb->oids[i]))
+			return 0;
+	return 1;
+}
+
+
+static bool lib_cacheable(void *const *oids, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i != n; i++)
+		if (!oids[i])
+			return 0;
+	return 1;
+}
+
+
+static const struct lib *find_lib(void *const *oids, unsigned n)
+{
+	struct lib_entry key;
+	const struct lib_entry *e;
+
+	if (!libs)
+		return NULL;
+	key.oids = (void **) oids;
+	key.n = n;
+	e = hash_lookup(libs, &key);
+	return e ? &e->lib : NULL;
+}
+
+
+const struct lib *cache_lib(void *const *oids, unsigned n)
+{
+	const struct lib *lib;
+
+	if (!lib_cacheable(oids, n))
+		return NULL;
+	pthread_mutex_lock(&lock);
+	lib = find_lib(oids, n);
+	pthread_mutex_unlock(&lock);
+	return lib;
+}
+
+
+void cache_add_lib(void *const *oids, unsigned n, const struct lib *lib)
+{
+	struct lib_entry *e;
+	unsigned i;
+
+	if (!lib_cacheable(oids, n))
+		return;
+	pthread_mutex_lock(&lock);
+	if (find_lib(oids, n))
+		goto out;
+	cache_init();
+	if (!libs)
+		libs = hash_new(arena, lib_hash, lib_eq);
+
+	e = arena_alloc_type(arena, struct lib_entry);
+	e->oids = arena_alloc_type_n(arena, void *, n);
+	for (i = 0; i != n; i++)
+		e->oids[i] = file_oid_dup(oids[i]);
+	e->n = n;
+	e->lib.arena = NULL;
+	lib_share(&e->lib, lib);
+	e->next = lib_list;
+	lib_list = e;
+	hash_insert(libs, e, e);
+out:
+	pthread_mutex_unlock(&lock);
+}
+
+
+/* ----- Library units ----------------------------------------------------- */
+
+
+static const struct lib *find_lib_file(const void *oid)
+{
+	if (!oid || !units)
+		return NULL;
+	return hash_lookup(units, oid);
+}
+
+
+const struct lib *cache_lib_file(const void *oid)
+{
+	const struct lib *unit;
+
+	pthread_mutex_lock(&lock);
+	unit = find_lib_file(oid);
+	pthread_mutex_unlock(&lock);
+	return unit;
+}
+
+
+void cache_add_lib_file(const void *oid, const struct lib *unit)
+{
+	struct unit_entry *e;
+
+	if (!oid)
+		return;
+	pthread_mutex_lock(&lock);
+	if (find_lib_file(oid))
+		goto out;
+	cache_init();
+	if (!units)
+		units = hash_new(arena, file_oid_hash, file_oid_eq);
+
+	e = arena_alloc_type(arena, struct unit_entry);
+	e->oid = file_oid_dup(oid);
+	e->unit = unit;
+	arena_ref(unit->arena);
+	e->next = unit_list;
+	unit_list = e;
+	hash_insert(units, e->oid, (void *) unit);
+out:
+	pthread_mutex_unlock(&lock);
+}
+
+
+/* ----- Cleanup ----------------------------------------------------------- */
+
+
+void cache_free(void)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&lock);
+	while (sheet_list) {
+		free(sheet_list->sheet.oid);
+		arena_unref(sheet_list->sheet.objs_arena);
+		sheet_list = sheet_list->next;
+	}
+	while (lib_list) {
+		for (i = 0; i != lib_list->n; i++)
+			free(lib_list->oids[i]);
+		lib_free(&lib_list->lib);
+		lib_list = lib_list->next;
+	}
+	while (unit_list) {
+		free(unit_list->oid);
+		arena_unref(unit_list->unit->arena);
+		unit_list = unit_list->next;
+	}
+	sheets = NULL;
+	libs = NULL;
+	units = NULL;
+	arena_unref(arena);
+	arena = NULL;
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,46 @@
+/*
+ * kicad/cache.h - Process-wide cache of parsed sheets and libraries
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef KICAD_CACHE_H
+#define KICAD_CACHE_H
+
+#include "misc/arena.h"
+#include "kicad/lib.h"
+#include "kicad/sch.h"
+
+
+/*
+ * Sheets are keyed by the OID of their blob. Since components are only looked
+ * up when rendering, sheets don't depend on the library. Combined libraries
+ * are keyed by the OIDs of all the library files they combine, and the
+ * libraries of individual files (units) by their OID.
+ *
+ * Only objects that come from a VCS can be cached. The cache holds
+ * references to the arenas of everything it contains.
+ *
+ * The cache can be used from several threads. Entries are only added once
+ * complete, and never change after that.
+ */
+
+const struct sheet *cache_sheet(const void *oid);
+void cache_add_sheet(const struct sheet *sheet, struct arena *sheet_arena);
+
+const struct lib *cache_lib(void *const *oids, unsigned n);
+void cache_add_lib(void *const *oids, unsigned n, const struct lib *lib);
+
+const struct lib *cache_lib_file(const void *oid);
+void cache_add_lib_file(const void *oid, const struct lib *unit);
+
+void cache_free(void);
+
+#endif /* !KICAD_CACHE_H */
@@ -86,7 +86,7 @@ static bool comp_eq_obj(const struct lib_obj *a, const struct lib_obj *b)
 		    a->u.text.style == b->u.text.style &&
 		    a->u.text.hor_align == b->u.text.hor_align &&
 		    a->u.text.vert_align == b->u.text.vert_align &&
-		    !strcmp(a->u.text.s, b->u.text.s);
+		    a->u.text.s == b->u.text.s;
 	case lib_obj_pin:
 		return a->u.pin.x == b->u.pin.x &&
 		    a->u.pin.y == b->u.pin.y &&
@@ -96,8 +96,8 @@ static bool comp_eq_obj(const struct lib_obj *a, const struct lib_obj *b)
 		    a->u.pin.name_size == b->u.pin.name_size &&
 		    a->u.pin.etype == b->u.pin.etype &&
 		    a->u.pin.shape == b->u.pin.shape &&
-		    !strcmp(a->u.pin.name, b->u.pin.name) &&
-		    !strcmp(a->u.pin.number, b->u.pin.number);
+		    a->u.pin.name == b->u.pin.name &&
+		    a->u.pin.number == b->u.pin.number;
 	default:
 		BUG("invalid type %d", a->type);
 	}
@@ -124,7 +124,7 @@ static bool comp_eq_aliases(const struct comp_alias *a,
     const struct comp_alias *b)
 {
 	while (a && b) {
-		if (strcmp(a->name, b->name))
+		if (a->name != b->name)
 			return 0;
 		a = a->next;
 		b = b->next;
@@ -139,7 +139,7 @@ static bool comp_eq(const struct comp *a, const struct comp *b)
 		return 1;
 	if (!(a && b))
 		return 0;
-	if (strcmp(a->name, b->name))
+	if (a->name != b->name)
 		return 0;
 	if (a->units != b->units)
 		return 0;
@@ -199,7 +199,7 @@ static bool comp_fields_eq(const struct comp_field *a,
 			return 0;
 		if (a->txt.hor != b->txt.hor || a->txt.vert != b->txt.vert)
 			return 0;
-		if (strcmp(a->txt.s, b->txt.s))
+		if (a->txt.s != b->txt.s)
 			return 0;
 		a = a->next;
 		b = b->next;
@@ -224,7 +224,7 @@ static bool sheet_fields_eq(const struct sheet_field *a,
 				continue;
 			if (ta->shape != tb->shape)
 				continue;
-			if (strcmp(ta->s, tb->s))
+			if (ta->s != tb->s)
 				continue;
 			goto match;
 		}
@@ -242,13 +242,30 @@ match:
 
 
 /*
- * @@@ idea: if we send all strings through a "unique" function, we can
- * memcmp things like "struct sch_text" without having to go through the
- * fields individually.
+ * The same name in the same library (libraries that share components also
+ * share the arena) yields the same component, so we only need to look up
+ * components if the libraries differ.
  */
 
-static bool obj_eq(const struct sch_obj *a, const struct sch_obj *b,
-    bool recurse)
+static bool sch_comp_eq(const struct sheet *sa, const struct sch_comp *a,
+    const struct sheet *sb, const struct sch_comp *b)
+{
+	if (sa->lib->arena == sb->lib->arena &&
+	    sa->embedded == sb->embedded && a->name && a->name == b->name)
+		return 1;
+	return comp_eq(sch_find_comp(sa, a), sch_find_comp(sb, b));
+}
+
+
+/*
+ * All strings are interned, so we compare them by pointer.
+ *
+ * @@@ idea: we could now memcmp things like "struct sch_text" without having
+ * to go through the fields individually, if it weren't for "bbox".
+ */
+
+static bool obj_eq(const struct sheet *sa, const struct sch_obj *a,
+    const struct sheet *sb, const struct sch_obj *b, bool recurse)
 {
 	if (a->type != b->type)
 		return 0;
@@ -285,11 +302,11 @@ static bool obj_eq(const struct sch_obj *a, const struct sch_obj *b,
 			return 0;
 		if (a->u.text.shape != b->u.text.shape)
 			return 0;
-		if (strcmp(a->u.text.s, b->u.text.s))
+		if (a->u.text.s != b->u.text.s)
 			return 0;
 		return 1;
 	case sch_obj_comp:
-		if (!comp_eq(a->u.comp.comp, b->u.comp.comp))
+		if (!sch_comp_eq(sa, &a->u.comp, sb, &b->u.comp))
 			return 0;
 		if (a->u.comp.unit != b->u.comp.unit)
 			return 0;
@@ -309,9 +326,9 @@ static bool obj_eq(const struct sch_obj *a, const struct sch_obj *b,
 			return 0;
 		if (a->u.sheet.rotated != b->u.sheet.rotated)
 			return 0;
-		if (strcmp(a->u.sheet.name, b->u.sheet.name))
+		if (a->u.sheet.name != b->u.sheet.name)
 			return 0;
-		if (strcmp(a->u.sheet.file, b->u.sheet.file))
+		if (a->u.sheet.file != b->u.sheet.file)
 			return 0;
 		if (!sheet_fields_eq(a->u.sheet.fields, b->u.sheet.fields))
 			return 0;
@@ -335,17 +352,13 @@ bool sheet_eq(const struct sheet *a, const struct sheet *b, bool recurse)
 	if (!(a && b))
 		return 0;
 
-	if (a->title != b->title) {
-		if (!a->title || !b->title)
-			return 0;
-		if (strcmp(a->title, b->title))
-			return 0;
-	}
+	if (a->title != b->title)
+		return 0;
 
 	obj_a = a->objs;
 	obj_b = b->objs;
 	while (obj_a && obj_b) {
-		if (!obj_eq(obj_a, obj_b, recurse))
+		if (!obj_eq(a, obj_a, b, obj_b, recurse))
 			return 0;
 		obj_a = obj_a->next;
 		obj_b = obj_b->next;
@@ -435,7 +448,12 @@ static void free_obj(struct sch_obj *obj)
 }
 
 
-static void init_res(struct sheet *res)
+/*
+ * The objects of a result sheet come from "from", so they also resolve
+ * components through it.
+ */
+
+static void init_res(struct sheet *res, const struct sheet *from)
 {
 	res->title = NULL;
 	res->file = NULL;
@@ -443,6 +461,11 @@ static void init_res(struct sheet *res)
 	res->objs = NULL;
 	res->next_obj = &res->objs;
 	res->next = NULL;
+	res->lib = from->lib;
+	res->syms = from->syms;
+	res->n_syms = from->n_syms;
+	res->comps = from->comps;
+	res->embedded = from->embedded;
 }
 
 
@@ -453,25 +476,25 @@ void delta(const struct sheet *a, const struct sheet *b,
 	struct sch_obj *next_a;
 	struct sch_obj **obj_b;
 
-	init_res(res_a);
-	init_res(res_b);
-	init_res(res_ab);
+	init_res(res_a, a);
+	init_res(res_b, b);
+	init_res(res_ab, a);
 
-	if (a->title && b->title && !strcmp(a->title, b->title)) {
+	if (a->title == b->title) {
 		res_ab->title = a->title;
 	} else {
 		res_a->title = a->title;
 		res_b->title = b->title;
 	}
 
-	if (a->file && b->file && !strcmp(a->file, b->file)) {
+	if (a->file == b->file) {
 		res_ab->file = a->file;
 	} else {
 		res_a->file = a->file;
 		res_b->file = b->file;
 	}
 
-	if (a->path && b->path && !strcmp(a->path, b->path)) {
+	if (a->path == b->path) {
 		res_ab->path = a->path;
 	} else {
 		res_a->path = a->path;
@@ -487,7 +510,7 @@ void delta(const struct sheet *a, const struct sheet *b,
 	while (objs_a) {
 		next_a = objs_a->next;
 		for (obj_b = &objs_b; *obj_b; obj_b = &(*obj_b)->next)
-			if (obj_eq(objs_a, *obj_b, 0)) {
+			if (obj_eq(a, objs_a, b, *obj_b, 0)) {
 				struct sch_obj *tmp = *obj_b;
 
 				add_obj(res_ab, objs_a);
@@ -0,0 +1,819 @@
+/*
+ * kicad/disk-cache.c - Persistent cache of parsed sheets and libraries
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "misc/util.h"
+#include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
+#include "misc/intern.h"
+#include "file/file.h"
+#include "kicad/dwg.h"
+#include "kicad/lib.h"
+#include "kicad/sch.h"
+#include "kicad/disk-cache.h"
+
+
+/*
+ * Cache entries are images of the parsed data, in the native layout. Each
+ * pointer is stored as 1 + the offset of its target in the image, or as 0 if
+ * it is NULL. We write everything an item points to before the item itself,
+ * so all pointers point backwards. This way, we can check each pointer while
+ * relocating the image, and a damaged entry can't make us loop.
+ *
+ * Since the layout is native, the header records the sizes of the main
+ * structures along with the format version. Entries that don't match, or
+ * whose checksum is wrong, are ignored.
+ *
+ * The image is position-independent. We read it into the arena in one go and
+ * relocate it there.
+ */
+
+#define	FORMAT_VERSION	2
+
+#define	ALIGN	(sizeof(void *) > sizeof(double) ? \
+		    sizeof(void *) : sizeof(double))
+
+#define	REF(r)	((void *) (uintptr_t) (r))
+
+
+struct header {
+	char magic[8];
+	uint32_t version;
+	uint32_t sizes[4];
+	uint32_t sum;		/* checksum of the image */
+	uint64_t size;		/* size of the image */
+	uint64_t root;		/* reference to the root item */
+};
+
+struct disk_lib {
+	struct comp *comps;
+};
+
+struct disk_obj {
+	unsigned fn;		/* index into wire_fns or text_fns */
+	struct sch_obj obj;
+};
+
+struct disk_sheet {
+	const char *title;
+	const char *size;
+	int w, h;
+	const char *date;
+	const char *rev;
+	const char *comp;
+	const char **comments;
+	unsigned n_comments;
+	struct disk_obj *objs;
+};
+
+
+static const char magic[8] = "eeshow";
+
+static void (*const wire_fns[])(struct gfx *gfx,
+    int sx, int sy, int ex, int ey) = {
+	dwg_wire,
+	dwg_bus,
+	dwg_line,
+};
+
+static void (*const text_fns[])(struct gfx *gfx, int x, int y, const char *s,
+    int dir, int dim, enum dwg_shape shape, enum text_style style,
+    struct dwg_bbox *bbox) = {
+	dwg_text,
+	dwg_label,
+	dwg_hlabel,
+	dwg_glabel,
+};
+
+
+/* ----- Cache directory --------------------------------------------------- */
+
+
+static bool make_dir(const char *path)
+{
+	if (!mkdir(path, 0777) || errno == EEXIST)
+		return 1;
+	progress(1, "%s: %s", path, strerror(errno));
+	return 0;
+}
+
+
+static char *top_dir = NULL;
+
+
+static void find_cache_dir(void)
+{
+	const char *base;
+	char *tmp;
+
+	base = getenv("XDG_CACHE_HOME");
+	if (base && *base == '/') {
+		tmp = stralloc(base);
+	} else {
+		base = getenv("HOME");
+		if (!base)
+			return;
+		alloc_printf(&tmp, "%s/.cache", base);
+	}
+	alloc_printf(&top_dir, "%s/eeshow", tmp);
+	if (!make_dir(tmp) || !make_dir(top_dir))
+		goto fail;
+	free(tmp);
+
+	alloc_printf(&tmp, "%s/lib", top_dir);
+	if (!make_dir(tmp))
+		goto fail;
+	free(tmp);
+	alloc_printf(&tmp, "%s/sch", top_dir);
+	if (!make_dir(tmp))
+		goto fail;
+	free(tmp);
+	return;
+
+fail:
+	free(tmp);
+	free(top_dir);
+	top_dir = NULL;
+}
+
+
+/* Files may be opened from several threads, so we set up the cache once. */
+
+static const char *cache_dir(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, find_cache_dir);
+	return top_dir;
+}
+
+
+static char *entry_path(const char *kind, const char *name)
+{
+	const char *dir = cache_dir();
+	char *path;
+
+	if (!dir)
+		return NULL;
+	alloc_printf(&path, "%s/%s/%s", dir, kind, name);
+	return path;
+}
+
+
+/* ----- Writing ----------------------------------------------------------- */
+
+
+struct image {
+	char *buf;
+	size_t size;
+	size_t alloc;
+};
+
+
+static uintptr_t put(struct image *img, const void *data, size_t size)
+{
+	size_t pos = img->size;
+	size_t end = pos + ((size + ALIGN - 1) & ~(ALIGN - 1));
+
+	if (end > img->alloc) {
+		while (img->alloc < end)
+			img->alloc = img->alloc ? img->alloc * 2 : 4096;
+		img->buf = realloc_size(img->buf, img->alloc);
+	}
+	memcpy(img->buf + pos, data, size);
+	memset(img->buf + pos + size, 0, end - pos - size);
+	img->size = end;
+	return pos + 1;
+}
+
+
+static uintptr_t put_str(struct image *img, const char *s)
+{
+	return s ? put(img, s, strlen(s) + 1) : 0;
+}
+
+
+static uint32_t checksum(const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+	uint32_t h = 2166136261u;
+
+	while (size--)
+		h = (h ^ *p++) * 16777619u;
+	return h;
+}
+
+
+static bool write_all(int fd, const void *buf, size_t size)
+{
+	ssize_t got;
+
+	while (size) {
+		got = write(fd, buf, size);
+		if (got <= 0)
+			return 0;
+		buf = (const char *) buf + got;
+		size -= got;
+	}
+	return 1;
+}
+
+
+static void store(const char *kind, const char *name,
+    const struct image *img, uintptr_t root)
+{
+	struct header hdr;
+	char *path, *tmp;
+	bool ok;
+	int fd;
+
+	path = entry_path(kind, name);
+	if (!path)
+		return;
+	if (!access(path, F_OK)) {
+		free(path);
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, magic, sizeof(magic));
+	hdr.version = FORMAT_VERSION;
+	hdr.sizes[0] = sizeof(void *);
+	hdr.sizes[1] = sizeof(struct comp);
+	hdr.sizes[2] = sizeof(struct lib_obj);
+	hdr.sizes[3] = sizeof(struct sch_obj);
+	hdr.sum = checksum(img->buf, img->size);
+	hdr.size = img->size;
+	hdr.root = root;
+
+	/* write a private copy and rename it, so readers never see a partial
+	   entry, and other writers (processes or threads) don't get in our way */
+	alloc_printf(&tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		progress(1, "%s: %s", tmp, strerror(errno));
+		goto out;
+	}
+	ok = write_all(fd, &hdr, sizeof(hdr)) &&
+	    write_all(fd, img->buf, img->size);
+	if (close(fd))
+		ok = 0;
+	if (ok && !rename(tmp, path))
+		progress(2, "cached %s", path);
+	else
+		unlink(tmp);
+out:
+	free(tmp);
+	free(path);
+}
+
+
+/* ----- Reading ----------------------------------------------------------- */
+
+
+struct reloc {
+	char *base;
+	bool ok;
+};
+
+
+/*
+ * Relocate a pointer to an item of "size" bytes that must lie before "limit".
+ */
+
+static void *rel(struct reloc *r, const void *p, size_t size,
+    const void *limit)
+{
+	uintptr_t off = (uintptr_t) p;
+	size_t max = (const char *) limit - r->base;
+
+	if (!off)
+		return NULL;
+	off--;
+	if (off % ALIGN || off > max || size > max - off) {
+		r->ok = 0;
+		return NULL;
+	}
+	return r->base + off;
+}
+
+
+/*
+ * Strings are interned, like when parsing, so they can be compared with
+ * strings from other sources by pointer.
+ */
+
+static const char *rel_str(struct reloc *r, const char *s, const void *limit)
+{
+	uintptr_t off = (uintptr_t) s;
+	size_t max = (const char *) limit - r->base;
+
+	if (!off)
+		return NULL;
+	off--;
+	if (off >= max || !memchr(r->base + off, 0, max - off)) {
+		r->ok = 0;
+		return NULL;
+	}
+	return intern(r->base + off);
+}
+
+
+static bool read_all(int fd, void *buf, size_t size)
+{
+	ssize_t got;
+
+	while (size) {
+		got = read(fd, buf, size);
+		if (got <= 0)
+			return 0;
+		buf = (char *) buf + got;
+		size -= got;
+	}
+	return 1;
+}
+
+
+/*
+ * Read an entry into the arena and return its root, which has "size" bytes.
+ */
+
+static void *load(const char *kind, const char *name, struct arena *arena,
+    struct reloc *r, size_t size)
+{
+	struct header hdr;
+	struct stat st;
+	char *path;
+	void *root = NULL;
+	int fd;
+
+	path = entry_path(kind, name);
+	if (!path)
+		return NULL;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		goto out;
+	if (fstat(fd, &st) || !read_all(fd, &hdr, sizeof(hdr)))
+		goto fail;
+	if (memcmp(hdr.magic, magic, sizeof(magic)) ||
+	    hdr.version != FORMAT_VERSION ||
+	    hdr.sizes[0] != sizeof(void *) ||
+	    hdr.sizes[1] != sizeof(struct comp) ||
+	    hdr.sizes[2] != sizeof(struct lib_obj) ||
+	    hdr.sizes[3] != sizeof(struct sch_obj) ||
+	    hdr.size != (uint64_t) st.st_size - sizeof(hdr))
+		goto fail;
+
+	r->base = arena_alloc(arena, hdr.size);
+	r->ok = 1;
+	if (!read_all(fd, r->base, hdr.size) ||
+	    checksum(r->base, hdr.size) != hdr.sum)
+		goto fail;
+	root = rel(r, REF(hdr.root), size, r->base + hdr.size);
+	if (root)
+		progress(2, "%s: from cache", path);
+
+fail:
+	close(fd);
+out:
+	free(path);
+	return root;
+}
+
+
+/* ----- Libraries --------------------------------------------------------- */
+
+
+static uintptr_t put_aliases(struct image *img, const struct comp_alias *alias)
+{
+	struct comp_alias tmp;
+	uintptr_t next;
+
+	if (!alias)
+		return 0;
+	next = put_aliases(img, alias->next);
+	tmp.name = REF(put_str(img, alias->name));
+	tmp.next = REF(next);
+	return put(img, &tmp, sizeof(tmp));
+}
+
+
+static uintptr_t put_lib_obj(struct image *img, const struct lib_obj *obj,
+    uintptr_t next)
+{
+	struct lib_obj tmp = *obj;
+	unsigned size;
+
+	switch (obj->type) {
+	case lib_obj_poly:
+		size = obj->u.poly.points * sizeof(int);
+		tmp.u.poly.x = REF(put(img, obj->u.poly.x, size));
+		tmp.u.poly.y = REF(put(img, obj->u.poly.y, size));
+		break;
+	case lib_obj_text:
+		tmp.u.text.s = REF(put_str(img, obj->u.text.s));
+		break;
+	case lib_obj_pin:
+		tmp.u.pin.name = REF(put_str(img, obj->u.pin.name));
+		tmp.u.pin.number = REF(put_str(img, obj->u.pin.number));
+		break;
+	default:
+		break;
+	}
+	tmp.next = REF(next);
+	return put(img, &tmp, sizeof(tmp));
+}
+
+
+static uintptr_t put_lib_objs(struct image *img, const struct lib_obj *objs)
+{
+	const struct lib_obj *obj;
+	const struct lib_obj **v = NULL;
+	unsigned n = 0;
+	uintptr_t next = 0;
+
+	for (obj = objs; obj; obj = obj->next) {
+		v = realloc_type_n(v, const struct lib_obj *, n + 1);
+		v[n++] = obj;
+	}
+	while (n--)
+		next = put_lib_obj(img, v[n], next);
+	free(v);
+	return next;
+}
+
+
+static uintptr_t put_comp(struct image *img, const struct comp *comp,
+    uintptr_t next)
+{
+	struct comp tmp = *comp;
+
+	tmp.name = REF(put_str(img, comp->name));
+	tmp.aliases = REF(put_aliases(img, comp->aliases));
+	tmp.objs = REF(put_lib_objs(img, comp->objs));
+	tmp.next = REF(next);
+	return put(img, &tmp, sizeof(tmp));
+}
+
+
+void disk_cache_store_lib(const struct lib *unit)
+{
+	struct image img = { NULL, 0, 0 };
+	struct disk_lib root;
+	const struct comp *comp;
+	const struct comp **v = NULL;
+	unsigned n = 0;
+	uintptr_t next = 0;
+
+	if (!unit->key || !cache_dir())
+		return;
+	for (comp = unit->comps; comp; comp = comp->next) {
+		v = realloc_type_n(v, const struct comp *, n + 1);
+		v[n++] = comp;
+	}
+	while (n--)
+		next = put_comp(&img, v[n], next);
+	free(v);
+
+	root.comps = REF(next);
+	next = put(&img, &root, sizeof(root));
+	store("lib", unit->key, &img, next);
+	free(img.buf);
+}
+
+
+static bool load_lib_obj(struct reloc *r, struct lib_obj *obj)
+{
+	size_t size;
+
+	switch (obj->type) {
+	case lib_obj_poly:
+		if (obj->u.poly.points < 0)
+			return 0;
+		size = obj->u.poly.points * sizeof(int);
+		obj->u.poly.x = rel(r, obj->u.poly.x, size, obj);
+		obj->u.poly.y = rel(r, obj->u.poly.y, size, obj);
+		break;
+	case lib_obj_text:
+		obj->u.text.s = rel_str(r, obj->u.text.s, obj);
+		break;
+	case lib_obj_pin:
+		obj->u.pin.name = rel_str(r, obj->u.pin.name, obj);
+		obj->u.pin.number = rel_str(r, obj->u.pin.number, obj);
+		break;
+	case lib_obj_rect:
+	case lib_obj_circ:
+	case lib_obj_arc:
+		break;
+	default:
+		return 0;
+	}
+	return r->ok;
+}
+
+
+static bool load_comp(struct reloc *r, struct comp *comp)
+{
+	struct comp_alias *alias;
+	struct lib_obj *obj;
+
+	comp->name = rel_str(r, comp->name, comp);
+	if (!comp->name)
+		return 0;
+	comp->aliases = rel(r, comp->aliases, sizeof(struct comp_alias), comp);
+	for (alias = comp->aliases; alias; alias = alias->next) {
+		alias->name = rel_str(r, alias->name, alias);
+		alias->next = rel(r, alias->next, sizeof(struct comp_alias),
+		    alias);
+		if (!alias->name)
+			return 0;
+	}
+	comp->objs = rel(r, comp->objs, sizeof(struct lib_obj), comp);
+	for (obj = comp->objs; obj; obj = obj->next) {
+		if (!load_lib_obj(r, obj))
+			return 0;
+		obj->next = rel(r, obj->next, sizeof(struct lib_obj), obj);
+	}
+	comp->next = rel(r, comp->next, sizeof(struct comp), comp);
+	return r->ok;
+}
+
+
+/*
+ * "unit" must be empty. If we fail half-way, it may be left with some
+ * components in its index, so the caller should then discard it.
+ */
+
+bool disk_cache_load_lib(struct lib *unit)
+{
+	struct reloc r;
+	struct disk_lib *root;
+	struct comp *comp;
+	const struct comp_alias *alias;
+
+	if (!unit->key)
+		return 0;
+	root = load("lib", unit->key, unit->arena, &r, sizeof(*root));
+	if (!root)
+		return 0;
+
+	comp = rel(&r, root->comps, sizeof(struct comp), root);
+	unit->comps = comp;
+	for (; comp; comp = comp->next) {
+		if (!load_comp(&r, comp))
+			return 0;
+		hash_insert(unit->index, comp->name, comp);
+		for (alias = comp->aliases; alias; alias = alias->next)
+			hash_insert(unit->index, alias->name, comp);
+	}
+	return r.ok;
+}
+
+
+/* ----- Sheets ------------------------------------------------------------ */
+
+
+static uintptr_t put_fields(struct image *img, const struct comp_field *field)
+{
+	struct comp_field tmp;
+	uintptr_t next;
+
+	if (!field)
+		return 0;
+	next = put_fields(img, field->next);
+	tmp = *field;
+	tmp.txt.s = REF(put_str(img, field->txt.s));
+	tmp.next = REF(next);
+	return put(img, &tmp, sizeof(tmp));
+}
+
+
+static int wire_fn(const struct sch_obj *obj)
+{
+	unsigned i;
+
+	for (i = 0; i != ARRAY_ELEMENTS(wire_fns); i++)
+		if (obj->u.wire.fn == wire_fns[i])
+			return i;
+	return -1;
+}
+
+
+static int text_fn(const struct sch_obj *obj)
+{
+	unsigned i;
+
+	for (i = 0; i != ARRAY_ELEMENTS(text_fns); i++)
+		if (obj->u.text.fn == text_fns[i])
+			return i;
+	return -1;
+}
+
+
+/*
+ * Returns 0 if we can't store the object.
+ */
+
+static uintptr_t put_sch_obj(struct image *img, const struct sch_obj *obj,
+    uintptr_t next)
+{
+	struct disk_obj tmp;
+	int fn = 0;
+
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.obj = *obj;
+	switch (obj->type) {
+	case sch_obj_wire:
+		fn = wire_fn(obj);
+		tmp.obj.u.wire.fn = NULL;
+		break;
+	case sch_obj_text:
+	case sch_obj_glabel:
+		fn = text_fn(obj);
+		tmp.obj.u.text.fn = NULL;
+		tmp.obj.u.text.s = REF(put_str(img, obj->u.text.s));
+		break;
+	case sch_obj_comp:
+		tmp.obj.u.comp.name = REF(put_str(img, obj->u.comp.name));
+		tmp.obj.u.comp.fields = REF(put_fields(img, obj->u.comp.fields));
+		break;
+	case sch_obj_junction:
+	case sch_obj_noconn:
+		break;
+	default:
+		return 0;
+	}
+	if (fn < 0)
+		return 0;
+	tmp.fn = fn;
+	tmp.obj.next = REF(next);
+	return put(img, &tmp, sizeof(tmp));
+}
+
+
+void disk_cache_store_sheet(const struct sheet *sheet)
+{
+	struct image img = { NULL, 0, 0 };
+	struct disk_sheet root;
+	const char *comments[sheet->n_comments + 1];
+	const struct sch_obj *obj;
+	const struct sch_obj **v = NULL;
+	unsigned n = 0, i;
+	uintptr_t next = 0;
+	char *key;
+
+	/* we don't store symbols, so sheets that bring their own aren't cached */
+	if (!sheet->oid || sheet->embedded)
+		return;
+	key = file_oid_str(sheet->oid);
+	if (!cache_dir())
+		goto out;
+
+	for (obj = sheet->objs; obj; obj = obj->next) {
+		v = realloc_type_n(v, const struct sch_obj *, n + 1);
+		v[n++] = obj;
+	}
+	while (n--) {
+		next = put_sch_obj(&img, v[n], next);
+		if (!next)
+			goto out;
+	}
+
+	root.objs = REF(next);
+	root.title = REF(put_str(&img, sheet->title));
+	root.size = REF(put_str(&img, sheet->size));
+	root.w = sheet->w;
+	root.h = sheet->h;
+	root.date = REF(put_str(&img, sheet->date));
+	root.rev = REF(put_str(&img, sheet->rev));
+	root.comp = REF(put_str(&img, sheet->comp));
+	for (i = 0; i != sheet->n_comments; i++)
+		comments[i] = REF(put_str(&img, sheet->comments[i]));
+	root.comments = REF(put(&img, comments,
+	    sheet->n_comments * sizeof(const char *)));
+	root.n_comments = sheet->n_comments;
+
+	next = put(&img, &root, sizeof(root));
+	store("sch", key, &img, next);
+
+out:
+	free(v);
+	free(img.buf);
+	free(key);
+}
+
+
+static bool load_sch_obj(struct reloc *r, struct disk_obj *d)
+{
+	struct sch_obj *obj = &d->obj;
+	struct comp_field *field;
+
+	switch (obj->type) {
+	case sch_obj_wire:
+		if (d->fn >= ARRAY_ELEMENTS(wire_fns))
+			return 0;
+		obj->u.wire.fn = wire_fns[d->fn];
+		break;
+	case sch_obj_text:
+	case sch_obj_glabel:
+		if (d->fn >= ARRAY_ELEMENTS(text_fns))
+			return 0;
+		obj->u.text.fn = text_fns[d->fn];
+		obj->u.text.s = rel_str(r, obj->u.text.s, d);
+		break;
+	case sch_obj_comp:
+		obj->u.comp.name = rel_str(r, obj->u.comp.name, d);
+		obj->u.comp.fields = rel(r, obj->u.comp.fields,
+		    sizeof(struct comp_field), d);
+		for (field = obj->u.comp.fields; field; field = field->next) {
+			field->txt.s = rel_str(r, field->txt.s, field);
+			field->next = rel(r, field->next,
+			    sizeof(struct comp_field), field);
+		}
+		break;
+	case sch_obj_junction:
+	case sch_obj_noconn:
+		break;
+	default:
+		return 0;
+	}
+	return r->ok;
+}
+
+
+bool disk_cache_load_sheet(struct sheet *sheet, struct arena *arena)
+{
+	struct reloc r;
+	struct disk_sheet *root;
+	struct disk_obj *d, *next;
+	struct sch_obj *objs;
+	char *key;
+	unsigned i;
+
+	if (!sheet->oid)
+		return 0;
+	key = file_oid_str(sheet->oid);
+	root = load("sch", key, arena, &r, sizeof(*root));
+	free(key);
+	if (!root)
+		return 0;
+
+	root->title = rel_str(&r, root->title, root);
+	root->size = rel_str(&r, root->size, root);
+	root->date = rel_str(&r, root->date, root);
+	root->rev = rel_str(&r, root->rev, root);
+	root->comp = rel_str(&r, root->comp, root);
+	root->comments = rel(&r, root->comments,
+	    root->n_comments * sizeof(const char *), root);
+	if (!r.ok || (root->n_comments && !root->comments))
+		return 0;
+	for (i = 0; i != root->n_comments; i++)
+		root->comments[i] =
+		    rel_str(&r, root->comments[i], root->comments);
+
+	d = rel(&r, root->objs, sizeof(struct disk_obj), root);
+	objs = d ? &d->obj : NULL;
+	for (; d; d = next) {
+		if (!load_sch_obj(&r, d))
+			return 0;
+		next = rel(&r, d->obj.next, sizeof(struct disk_obj), d);
+		d->obj.next = next ? &next->obj : NULL;
+	}
+	if (!r.ok)
+		return 0;
+
+	sheet->objs = objs;
+	sheet->title = root->title;
+	sheet->size = root->size;
+	sheet->w = root->w;
+	sheet->h = root->h;
+	sheet->date = root->date;
+	sheet->rev = root->rev;
+	sheet->comp = root->comp;
+	sheet->comments = root->comments;
+	sheet->n_comments = root->n_comments;
+	return 1;
+}
@@ -0,0 +1,39 @@
+/*
+ * kicad/disk-cache.h - Persistent cache of parsed sheets and libraries
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef KICAD_DISK_CACHE_H
+#define KICAD_DISK_CACHE_H
+
+#include <stdbool.h>
+
+#include "misc/arena.h"
+#include "kicad/lib.h"
+#include "kicad/sch.h"
+
+
+/*
+ * Libraries (units) are stored under the OID of their file, i.e., lib->key.
+ * Sheets are stored under the OID of their file. Only sheets without
+ * sub-sheets can be stored.
+ *
+ * The load functions return 0 if the item isn't in the cache, or if the
+ * cache is unusable. The store functions fail silently.
+ */
+
+bool disk_cache_load_lib(struct lib *unit);
+void disk_cache_store_lib(const struct lib *unit);
+
+bool disk_cache_load_sheet(struct sheet *sheet, struct arena *arena);
+void disk_cache_store_sheet(const struct sheet *sheet);
+
+#endif /* !KICAD_DISK_CACHE_H */
@@ -31,9 +31,9 @@ enum ext identify(const char *path)
 
 	if (!strcmp(dot, ".pro"))
 		return ext_project;
-	if (!strcmp(dot, ".sch"))
+	if (!strcmp(dot, ".sch") || !strcmp(dot, ".kicad_sch"))
 		return ext_sch;
-	if (!strcmp(dot, ".lib"))
+	if (!strcmp(dot, ".lib") || !strcmp(dot, ".kicad_sym"))
 		return ext_lib;
 	if (!strcmp(dot, ".kicad_wks"))
 		return ext_pl;
@@ -25,4 +25,15 @@
 #define	DEFAULT_LIBRARY_PATHS	KICAD_DATAS_PATH("/library")
 #define DEFAULT_TEMPLATE_PATHS	KICAD_DATAS_PATH("/template")
 
+
+/*
+ * The s-expression formats (.kicad_sch, .kicad_sym) use millimeters. We work
+ * in mils, like the legacy formats.
+ */
+
+static inline int mm_to_mil(double mm)
+{
+	return mm < 0 ? mm / 0.0254 - 0.5 : mm / 0.0254 + 0.5;
+}
+
 #endif /* !KICAD_KICAD_H */
@@ -13,16 +13,23 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <string.h>
 #include <assert.h>
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
+#include "misc/pool.h"
+#include "misc/intern.h"
 #include "gfx/text.h"
 #include "file/file.h"
 #include "kicad/kicad.h"
 #include "kicad/ext.h"
+#include "kicad/tok.h"
 #include "kicad/lib.h"
+#include "kicad/cache.h"
+#include "kicad/disk-cache.h"
 
 
 static const char *builtin_paths[] = {
@@ -33,16 +40,19 @@ static const char *builtin_paths[] = {
 /* ----- Text -------------------------------------------------------------- */
 
 
-static enum text_style decode_style(const char *s, unsigned bold)
+static enum text_style decode_style(const char *s, unsigned len,
+    unsigned bold)
 {
 	enum text_style res;
 
-	if (!strcmp(s, "Normal"))
+	if (tok_eq(s, len, "Normal")) {
 		res = text_normal;
-	else if (!strcmp(s, "Italic"))
+	} else if (tok_eq(s, len, "Italic")) {
 		res = text_italic;
-	else
-		error("unrecognized text attribute \"%s\"", s);
+	} else {
+		error("unrecognized text attribute \"%.*s\"", (int) len, s);
+		res = text_normal;
+	}
 
 	if (bold)
 		res |= text_bold;
@@ -54,53 +64,66 @@ static enum text_style decode_style(const char *s, unsigned bold)
 /* ----- Polygons ---------------------------------------------------------- */
 
 
-static bool parse_poly(struct lib_poly *poly, const char *line, int points)
+/*
+ * The coordinates are stored right after the object, in the same allocation.
+ */
+
+static struct lib_obj *parse_poly(struct lib *lib, const struct lib_obj *tmp,
+    struct tok *tok, int points)
 {
-	int i, n;
+	struct lib_obj *obj;
+	struct lib_poly *poly;
+	int i;
 
+	obj = arena_alloc(lib->arena,
+	    sizeof(struct lib_obj) + 2 * points * sizeof(int));
+	*obj = *tmp;
+	poly = &obj->u.poly;
 	poly->points = points;
-	poly->x = alloc_type_n(int, points);
-	poly->y = alloc_type_n(int, points);
-	for (i = 0; i != points; i++) {
-		if (sscanf(line, "%d %d %n",
-		    poly->x + i, poly->y + i, &n) != 2)
-			return 0;
-		line += n;
-	}
-	if (sscanf(line, "%c", &poly->fill) != 1)
+	poly->x = (int *) (obj + 1);
+	poly->y = poly->x + points;
+	for (i = 0; i != points; i++)
+		if (!tok_int(tok, poly->x + i) || !tok_int(tok, poly->y + i))
+			return NULL;
+	if (!tok_char(tok, &poly->fill))
 		poly->fill = 'N';
-	return 1;
+	return obj;
 }
 
 
 /* ----- Definitions ------------------------------------------------------- */
 
 
-static bool parse_def(struct lib *lib, const char *line)
+/*
+ * DEF name reference unused text_offset draw_numbers draw_names units ...
+ */
+
+static bool parse_def(struct lib *lib, struct tok *tok)
 {
-	char *s, *ref;
+	const char *name, *ref;
+	unsigned name_len, ref_len;
 	char draw_num, draw_name;
 	unsigned name_offset;
 	unsigned units;
 	bool power;
+	int dummy;
 
-	if (sscanf(line, "DEF %ms %ms %*d %u %c %c %u",
-	    &s, &ref, &name_offset, &draw_num, &draw_name, &units) != 6)
+	if (!tok_is(tok, "DEF") ||
+	    !tok_word(tok, &name, &name_len) || !tok_word(tok, &ref, &ref_len) ||
+	    !tok_int(tok, &dummy) || !tok_unsigned(tok, &name_offset) ||
+	    !tok_char(tok, &draw_num) || !tok_char(tok, &draw_name) ||
+	    !tok_unsigned(tok, &units))
 		return 0;
 
 	power = *ref == '#';
-	free(ref);
 
-	lib->curr_comp = alloc_type(struct comp);
-	if (*s == '~') {
-		char *tmp = alloc_size(strlen(s) + 1);
-
-		/* we can't just s++, since that would break freeing */
-		strcpy(tmp, s + 1);
-		free(s);
-		s = tmp;
+	lib->curr_comp = arena_alloc_type(lib->arena, struct comp);
+	if (*name == '~') {
+		name++;
+		name_len--;
 	}
-	lib->curr_comp->name = s;
+	lib->curr_comp->name = intern_n(name, name_len);
+	hash_insert(lib->index, lib->curr_comp->name, lib->curr_comp);
 	lib->curr_comp->aliases = NULL;
 	lib->curr_comp->units = units;
 
@@ -123,16 +146,23 @@ static bool parse_def(struct lib *lib, const char *line)
 /* ----- Arcs -------------------------------------------------------------- */
 
 
-static bool parse_arc(struct lib_obj *obj, const char *line)
+/*
+ * A x y radius start_angle end_angle unit convert thickness [fill] ...
+ */
+
+static bool parse_arc(struct lib_obj *obj, struct tok *tok)
 {
 	struct lib_arc *arc = &obj->u.arc;
 	int a1, a2;
 
-	arc->fill = 'N';
-	if (sscanf(line, "A %d %d %d %d %d %u %u %u %c",
-	    &arc->x, &arc->y, &arc->r, &a1, &a2, &obj->unit, &obj->convert,
-	    &arc->thick, &arc->fill) < 8)
+	if (!tok_int(tok, &arc->x) || !tok_int(tok, &arc->y) ||
+	    !tok_int(tok, &arc->r) || !tok_int(tok, &a1) ||
+	    !tok_int(tok, &a2) ||
+	    !tok_unsigned(tok, &obj->unit) || !tok_unsigned(tok, &obj->convert) ||
+	    !tok_int(tok, &arc->thick))
 		return 0;
+	if (!tok_char(tok, &arc->fill))
+		arc->fill = 'N';
 
 	/*
 	 * KiCad arcs can be clockwise or counter-clockwise. They must always
@@ -161,210 +191,277 @@ static bool parse_arc(struct lib_obj *obj, const char *line)
 /* ----- Aliases ----------------------------------------------------------- */
 
 
-static void add_alias(struct comp *comp, const char *alias)
+void lib_add_alias(struct lib *lib, struct comp *comp, const char *alias,
+    unsigned len)
 {
 	struct comp_alias *new;
 
-	new = alloc_type(struct comp_alias);
-	new->name = alias;
+	new = arena_alloc_type(lib->arena, struct comp_alias);
+	new->name = intern_n(alias, len);
 	new->next = comp->aliases;
 	comp->aliases = new;
+	hash_insert(lib->index, new->name, comp);
 }
 
 
-static bool add_aliases(struct comp *comp, const char *line)
+static void add_aliases(struct lib *lib, struct comp *comp, struct tok *tok)
 {
-	const char *p;
-	int n;
-	char *s;
+	const char *s;
+	unsigned len;
 
-	if (strncmp(line, "ALIAS", 5))
-		return 0;
-	if (!isspace(line[5]))
-		return 0;
-	for (p = line + 5; sscanf(p, " %ms%n", &s, &n) == 1; p += n)
-		add_alias(comp, s);
-	return 1;
+	while (tok_word(tok, &s, &len))
+		lib_add_alias(lib, comp, s, len);
 }
 
 
 /* ----- Library parser ---------------------------------------------------- */
 
 
-static enum pin_shape decode_pin_shape(const char *s)
+static enum pin_shape decode_pin_shape(const char *s, unsigned len)
 {
 	int flags = 0;
 
-	if (*s == 'N') {
+	if (len && *s == 'N') {
 		flags = pin_invisible;
 		s++;
+		len--;
 	}
-	if (!strcmp(s, ""))
+	if (!len)
 		return flags;
-	if (!strcmp(s, "I"))
+	if (tok_eq(s, len, "I"))
 		return flags | pin_inverted;
-	if (!strcmp(s, "C"))
+	if (tok_eq(s, len, "C"))
 		return flags | pin_clock;
-	if (!strcmp(s, "CI") || !strcmp(s, "IC"))
+	if (tok_eq(s, len, "CI") || tok_eq(s, len, "IC"))
 		return flags | pin_clock | pin_inverted;
-	if (!strcmp(s, "L"))
+	if (tok_eq(s, len, "L"))
 		return flags | pin_input_low;
-	if (!strcmp(s, "CL"))
+	if (tok_eq(s, len, "CL"))
 		return flags | pin_clock | pin_input_low;
-	if (!strcmp(s, "V"))
+	if (tok_eq(s, len, "V"))
 		return flags | pin_output_low;;
-	if (!strcmp(s, "F"))
+	if (tok_eq(s, len, "F"))
 		return flags | pin_falling_edge;
-	if (!strcmp(s, "X"))
+	if (tok_eq(s, len, "X"))
 		return flags | pin_non_logic;
-	error("unrecognized pin shape \"%s\"", s);
+	error("unrecognized pin shape \"%.*s\"", (int) len, s);
 	return flags;
 }
 
 
+static void submit_obj(struct lib *lib, struct lib_obj *obj)
+{
+	obj->next = NULL;
+	*lib->next_obj = obj;
+	lib->next_obj = &obj->next;
+}
+
+
+static struct lib_obj *add_obj(struct lib *lib, const struct lib_obj *tmp)
+{
+	struct lib_obj *obj;
+
+	obj = arena_alloc_type(lib->arena, struct lib_obj);
+	*obj = *tmp;
+	submit_obj(lib, obj);
+	return obj;
+}
+
+
+/*
+ * T orient x y dim 0 unit convert text [style [bold [hor_align [vert_align]]]]
+ *
+ * The text is either in double quotes or a single word, with ~ standing for
+ * a space.
+ */
+
+static bool parse_text(const struct file *file, struct lib *lib,
+    struct lib_obj *obj, struct tok *tok, const char *line)
+{
+	const char *s, *style = NULL;
+	unsigned len, style_len = 0;
+	unsigned zero, bold = 0;
+	bool quoted;
+	char *tmp, *p;
+
+	if (!tok_int(tok, &obj->u.text.orient) ||
+	    !tok_int(tok, &obj->u.text.x) || !tok_int(tok, &obj->u.text.y) ||
+	    !tok_int(tok, &obj->u.text.dim) || !tok_unsigned(tok, &zero) ||
+	    !tok_unsigned(tok, &obj->unit) || !tok_unsigned(tok, &obj->convert))
+		return 0;
+	quoted = tok_str(tok, &s, &len);
+	if (!quoted && !tok_word(tok, &s, &len))
+		return 0;
+	if (zero)
+		fatal("%u: only understand 0 x x\n\"%s\"", file->lineno, line);
+
+	obj->u.text.hor_align = 'C';
+	obj->u.text.vert_align = 'C';
+	if (tok_word(tok, &style, &style_len) && tok_unsigned(tok, &bold) &&
+	    tok_char(tok, &obj->u.text.hor_align))
+		tok_char(tok, &obj->u.text.vert_align);
+	obj->u.text.style =
+	    style ? decode_style(style, style_len, bold) : text_normal;
+
+	if (quoted || !memchr(s, '~', len)) {
+		obj->u.text.s = intern_n(s, len);
+	} else {
+		tmp = p = alloc_size(len + 1);
+		memcpy(tmp, s, len);
+		tmp[len] = 0;
+		while ((p = strchr(p, '~')))
+			*p = ' ';
+		obj->u.text.s = intern(tmp);
+		free(tmp);
+	}
+	obj->type = lib_obj_text;
+	return 1;
+}
+
+
+/*
+ * X name number x y length orient number_size name_size unit convert etype
+ *   [shape]
+ */
+
+static bool parse_pin(struct lib *lib, struct lib_obj *obj, struct tok *tok)
+{
+	const char *name, *num, *shape;
+	unsigned name_len, num_len, shape_len;
+
+	if (!tok_word(tok, &name, &name_len) || !tok_word(tok, &num, &num_len) ||
+	    !tok_int(tok, &obj->u.pin.x) || !tok_int(tok, &obj->u.pin.y) ||
+	    !tok_int(tok, &obj->u.pin.length) ||
+	    !tok_char(tok, &obj->u.pin.orient) ||
+	    !tok_int(tok, &obj->u.pin.number_size) ||
+	    !tok_int(tok, &obj->u.pin.name_size) ||
+	    !tok_unsigned(tok, &obj->unit) || !tok_unsigned(tok, &obj->convert) ||
+	    !tok_char(tok, &obj->u.pin.etype))
+		return 0;
+	obj->type = lib_obj_pin;
+	obj->u.pin.name = intern_n(name, name_len);
+	obj->u.pin.number = intern_n(num, num_len);
+	if (tok_word(tok, &shape, &shape_len))
+		obj->u.pin.shape = decode_pin_shape(shape, shape_len);
+	else
+		obj->u.pin.shape = 0;
+	return 1;
+}
+
+
 static bool lib_parse_line(const struct file *file,
     void *user, const char *line)
 {
 	struct lib *lib = user;
-	int n = 0;	/* use ONLY for %n */
-	int i;
+	struct tok tok;
+	unsigned i;
 	unsigned points;
-	struct lib_obj *obj;
-	char *s, *style;
-	unsigned zero, bold;
+	struct lib_obj tmp;
+	struct lib_obj *obj = &tmp;
+	const char *s;
+	unsigned len;
+	int dummy;
 	char vis;
 
+	tok_init(&tok, line);
 	switch (lib->state) {
 	case lib_skip:
-		if (parse_def(lib, line)) {
+		if (parse_def(lib, &tok)) {
 			lib->state = lib_def;
 			return 1;
 		}
+		if (tok_prefix(&tok, "(kicad_symbol_lib")) {
+			lib->state = lib_sexpr;
+			return lib_sexpr_parse_line(lib, line);
+		}
 		return 1;
 	case lib_def:
-		if (sscanf(line, "DRAW%n", &n) == 0 && n) {
+		if (tok_is(&tok, "DRAW")) {
 			lib->state = lib_draw;
 			return 1;
 		}
-		if (sscanf(line, "F%d \"\" %*d %*d %*d %*c %c", &i, &vis) == 2
-		    || sscanf(line, "F%d \"%*[^\"]\" %*d %*d %*d %*c %c",
-		    &i, &vis) == 2) {
-			if (vis == 'V')
+		if (tok_prefix(&tok, "F")) {
+			if (tok_unsigned(&tok, &i) && tok_str(&tok, &s, &len) &&
+			    tok_int(&tok, &dummy) && tok_int(&tok, &dummy) &&
+			    tok_int(&tok, &dummy) && tok_char(&tok, &vis) &&
+			    tok_char(&tok, &vis) && vis == 'V')
 				lib->curr_comp->visible |= 1 << i;
 			return 1;
 		}
-		if (add_aliases(lib->curr_comp, line))
+		if (tok_is(&tok, "ALIAS")) {
+			add_aliases(lib, lib->curr_comp, &tok);
 			return 1;
+		}
 		/* @@@ explicitly ignore FPLIST */
 		return 1;
 	case lib_draw:
-		if (sscanf(line, "ENDDRAW%n", &n) == 0 && n) {
+		if (tok_is(&tok, "ENDDRAW")) {
 			lib->state = lib_skip;
 			return 1;
 		}
 
-		obj = alloc_type(struct lib_obj);
-		obj->next = NULL;
-		*lib->next_obj = obj;
-		lib->next_obj = &obj->next;
-
-		if (sscanf(line, "P %u %u %u %u %n",
-		    &points, &obj->unit, &obj->convert, &obj->u.poly.thick,
-		    &n) == 4) {
+		if (tok_is(&tok, "P")) {
+			if (!tok_unsigned(&tok, &points) ||
+			    !tok_unsigned(&tok, &obj->unit) ||
+			    !tok_unsigned(&tok, &obj->convert) ||
+			    !tok_int(&tok, &obj->u.poly.thick))
+				break;
 			obj->type = lib_obj_poly;
-			if (parse_poly(&obj->u.poly, line + n, points))
-				return 1;
-			break;
+			obj = parse_poly(lib, obj, &tok, points);
+			if (!obj)
+				break;
+			submit_obj(lib, obj);
+			return 1;
 		}
-		if (sscanf(line, "S %d %d %d %d %u %u %d %c",
-		    &obj->u.rect.sx, &obj->u.rect.sy, &obj->u.rect.ex,
-		    &obj->u.rect.ey, &obj->unit, &obj->convert,
-		    &obj->u.rect.thick, &obj->u.rect.fill) == 8) {
+		if (tok_is(&tok, "S")) {
+			if (!tok_int(&tok, &obj->u.rect.sx) ||
+			    !tok_int(&tok, &obj->u.rect.sy) ||
+			    !tok_int(&tok, &obj->u.rect.ex) ||
+			    !tok_int(&tok, &obj->u.rect.ey) ||
+			    !tok_unsigned(&tok, &obj->unit) ||
+			    !tok_unsigned(&tok, &obj->convert) ||
+			    !tok_int(&tok, &obj->u.rect.thick) ||
+			    !tok_char(&tok, &obj->u.rect.fill))
+				break;
 			obj->type = lib_obj_rect;
+			add_obj(lib, obj);
 			return 1;
 		}
-		if (sscanf(line, "C %d %d %d %u %u %d %c",
-		    &obj->u.circ.x, &obj->u.circ.y, &obj->u.circ.r,
-		    &obj->unit, &obj->convert, &obj->u.circ.thick,
-		    &obj->u.circ.fill) == 7) {
+		if (tok_is(&tok, "C")) {
+			if (!tok_int(&tok, &obj->u.circ.x) ||
+			    !tok_int(&tok, &obj->u.circ.y) ||
+			    !tok_int(&tok, &obj->u.circ.r) ||
+			    !tok_unsigned(&tok, &obj->unit) ||
+			    !tok_unsigned(&tok, &obj->convert) ||
+			    !tok_int(&tok, &obj->u.circ.thick) ||
+			    !tok_char(&tok, &obj->u.circ.fill))
+				break;
 			obj->type = lib_obj_circ;
+			add_obj(lib, obj);
 			return 1;
 		}
-		if (parse_arc(obj, line)) {
+		if (tok_is(&tok, "A")) {
+			if (!parse_arc(obj, &tok))
+				break;
 			obj->type = lib_obj_arc;
+			add_obj(lib, obj);
 			return 1;
 		}
-		n = sscanf(line,
-		    "T %d %d %d %d %u %u %u \"%m[^\"]\" %ms %u %c %c",
-		    &obj->u.text.orient, &obj->u.text.x, &obj->u.text.y,
-		    &obj->u.text.dim, &zero, &obj->unit, &obj->convert,
-		    &obj->u.text.s, &style, &bold,
-		    &obj->u.text.hor_align, &obj->u.text.vert_align);
-		if (n != 12) {
-			n = sscanf(line,
-			    "T %d %d %d %d %u %u %u %ms %ms %u %c %c",
-			    &obj->u.text.orient, &obj->u.text.x, &obj->u.text.y,
-			    &obj->u.text.dim, &zero, &obj->unit, &obj->convert,
-			    &obj->u.text.s, &style, &bold,
-			    &obj->u.text.hor_align, &obj->u.text.vert_align);
-
-			switch (n) {
-			case 8:
-				style= NULL;
-				n++;
-				/* fall through */
-			case 9:
-				bold = 0;
-				n++;
-				/* fall through */
-			case 10:
-				obj->u.text.hor_align = 'C';
-				n++;
-				/* fall through */
-			case 11:
-				obj->u.text.vert_align = 'C';
-				n++;
-				/* fall through */
-			default:
+		if (tok_is(&tok, "T")) {
+			if (!parse_text(file, lib, obj, &tok, line))
 				break;
-			}
-
-			while (n == 12) {
-				char *tilde;
-
-				tilde = strchr(obj->u.text.s, '~');
-				if (!tilde)
-					break;
-				*tilde = ' ';
-			}
-		}
-		if (n == 12) {
-			if (zero)
-				fatal("%u: only understand 0 x x\n"
-				    "\"%s\"", file->lineno, line);
-			obj->u.text.style =
-			    style ? decode_style(style, bold) : text_normal;
-			obj->type = lib_obj_text;
-			free(style);
+			add_obj(lib, obj);
 			return 1;
 		}
-		s = NULL;
-		if (sscanf(line, "X %ms %ms %d %d %d %c %d %d %u %u %c %ms",
-		    &obj->u.pin.name, &obj->u.pin.number,
-		    &obj->u.pin.x, &obj->u.pin.y, &obj->u.pin.length,
-		    &obj->u.pin.orient,
-		    &obj->u.pin.number_size, &obj->u.pin.name_size,
-		    &obj->unit, &obj->convert, &obj->u.pin.etype, &s) >= 11) {
-			obj->type = lib_obj_pin;
-			if (s) {
-				obj->u.pin.shape = decode_pin_shape(s);
-				free(s);
-			} else {
-				obj->u.pin.shape = 0;
-			}
+		if (tok_is(&tok, "X")) {
+			if (!parse_pin(lib, obj, &tok))
+				break;
+			add_obj(lib, obj);
 			return 1;
 		}
 		break;
+	case lib_sexpr:
+		return lib_sexpr_parse_line(lib, line);
 	default:
 		BUG("invalid state %d", lib->state);
 	}
@@ -374,8 +471,17 @@ static bool lib_parse_line(const struct file *file,
 
 bool lib_parse_file(struct lib *lib, struct file *file)
 {
+	bool ok;
+
 	lib->state = lib_skip;
-	return file_read(file, lib_parse_line, lib);
+	ok = file_read(file, lib_parse_line, lib);
+	if (lib->sexpr) {
+		if (ok)
+			error("%s: unexpected end of file", file->name);
+		lib_sexpr_free(lib);
+		return 0;
+	}
+	return ok;
 }
 
 
@@ -393,6 +499,152 @@ bool lib_parse(struct lib *lib, const char *name, const struct file *related)
 }
 
 
+/* ----- Parsing multiple libraries ---------------------------------------- */
+
+
+/*
+ * Each library file is parsed into a library of its own (a "unit"), which
+ * lives in its own arena, together with its struct lib. A combined library
+ * just points to its units. Units of files we've already parsed (according to
+ * their OID) are shared.
+ */
+
+struct lib_job {
+	struct file *file;
+	void *oid;
+	struct lib *unit;
+	bool cached;		/* shared from the process-wide cache */
+	bool parse;		/* not cached anywhere */
+	bool ok;
+};
+
+
+static void init_lib(struct lib *lib, struct arena *arena)
+{
+	lib->arena = arena;
+	lib->comps = NULL;
+	lib->next_comp = &lib->comps;
+	lib->index = hash_new(arena, hash_str, hash_str_eq);
+	lib->units = NULL;
+	lib->n_units = 0;
+	lib->key = NULL;
+	lib->sexpr = NULL;
+}
+
+
+static struct lib *new_unit(const void *oid)
+{
+	struct arena *arena = arena_new();
+	struct lib *unit;
+	char *s;
+
+	unit = arena_alloc_type(arena, struct lib);
+	init_lib(unit, arena);
+	if (oid) {
+		s = file_oid_str(oid);
+		unit->key = arena_strdup(arena, s);
+		free(s);
+	}
+	return unit;
+}
+
+
+static void add_units(struct lib *lib, const struct lib **units, unsigned n)
+{
+	const struct lib **tmp;
+	unsigned i;
+
+	tmp = arena_alloc_type_n(lib->arena, const struct lib *,
+	    lib->n_units + n);
+	if (lib->n_units)
+		memcpy(tmp, lib->units, lib->n_units * sizeof(*tmp));
+	for (i = 0; i != n; i++) {
+		arena_attach(lib->arena, units[i]->arena);
+		tmp[lib->n_units + i] = units[i];
+	}
+	lib->units = tmp;
+	lib->n_units += n;
+}
+
+
+static void parse_job(void *user)
+{
+	struct lib_job *job = user;
+
+	job->ok = lib_parse_file(job->unit, job->file);
+}
+
+
+/*
+ * Parse the (already opened) library files, in this order. If we can use
+ * more than one job, the units are parsed in parallel.
+ */
+
+bool lib_parse_files(struct lib *lib, struct file *files, unsigned n)
+{
+	struct lib_job job[n ? n : 1];
+	const struct lib *units[n ? n : 1];
+	const struct lib *cached;
+	struct pool *pool;
+	bool ok = 1;
+	unsigned i;
+
+	/* .kicad_sch files bring their own symbols, so there may be no libs */
+	if (!n)
+		return 1;
+
+	pool = pool_new(jobs < n ? jobs : n);
+	for (i = 0; i != n; i++) {
+		job[i].file = files + i;
+		job[i].oid = file_oid(files + i);
+		cached = cache_lib_file(job[i].oid);
+		job[i].cached = cached;
+		job[i].parse = 0;
+		job[i].ok = 1;
+		if (cached) {
+			progress(2, "%s: cached", files[i].name);
+			job[i].unit = (struct lib *) cached;
+			continue;
+		}
+		job[i].unit = new_unit(job[i].oid);
+		if (disk_cache_load_lib(job[i].unit))
+			continue;
+		if (job[i].unit->comps) {
+			/* partially loaded; start over */
+			arena_unref(job[i].unit->arena);
+			job[i].unit = new_unit(job[i].oid);
+		}
+		job[i].parse = 1;
+		pool_add(pool, parse_job, job + i);
+	}
+	pool_wait(pool);
+	pool_free(pool);
+
+	for (i = 0; i != n; i++) {
+		if (!job[i].ok) {
+			ok = 0;
+		} else if (!job[i].cached) {
+			cache_add_lib_file(job[i].oid, job[i].unit);
+			if (job[i].parse)
+				disk_cache_store_lib(job[i].unit);
+		}
+		units[i] = job[i].unit;
+	}
+	if (ok)
+		add_units(lib, units, n);
+
+	for (i = 0; i != n; i++) {
+		if (!job[i].cached)
+			arena_unref(job[i].unit->arena);
+		free(job[i].oid);
+	}
+	return ok;
+}
+
+
+/* ----- Finding library files --------------------------------------------- */
+
+
 static bool do_find_file(struct file *file, const char *name,
     const struct file_names *fn, const struct file *related)
 {
@@ -433,59 +685,37 @@ bool lib_parse_search(struct lib *lib, const char *name,
 
 void lib_init(struct lib *lib)
 {
-	lib->comps = NULL;
-	lib->next_comp = &lib->comps;
+	init_lib(lib, arena_new());
 }
 
 
-static void free_objs(struct lib_obj *objs)
-{
-	struct lib_obj *next;
-
-	while (objs) {
-		next = objs->next;
-		switch (objs->type) {
-		case lib_obj_poly:
-			free(objs->u.poly.x);
-			free(objs->u.poly.y);
-			break;
-		case lib_obj_text:
-			free((char *) objs->u.text.s);
-			break;
-		case lib_obj_pin:
-			free((char *) objs->u.pin.name);
-			free((char *) objs->u.pin.number);
-			break;
-		default:
-			break;
-		}
-		free(objs);
-		objs = next;
-	}
-}
-
+/*
+ * Make "lib" use the components of "from", e.g., if the library files are
+ * the same in two revisions. "lib" must have been initialized and be empty.
+ * Both libraries can then be freed independently.
+ */
 
-static void free_comp(struct comp *comp)
+void lib_share(struct lib *lib, const struct lib *from)
 {
-	struct comp_alias *next;
-
-	free((char *) comp->name);
-	while (comp->aliases) {
-		next = comp->aliases->next;
-		free((char *) comp->aliases->name);
-		comp->aliases = next;
-	}
-	free_objs(comp->objs);
-	free(comp);
+	arena_unref(lib->arena);
+	lib->arena = arena_ref(from->arena);
+	lib->comps = from->comps;
+	lib->next_comp = NULL;
+	lib->index = from->index;
+	lib->units = from->units;
+	lib->n_units = from->n_units;
+	lib->key = from->key;
+	lib->sexpr = NULL;
 }
 
 
 void lib_free(struct lib *lib)
 {
-	struct comp *comp, *next;
-
-	for (comp = lib->comps; comp; comp = next) {
-		next = comp->next;
-		free_comp(comp);
-	}
+	arena_unref(lib->arena);
+	lib->arena = NULL;
+	lib->comps = NULL;
+	lib->index = NULL;
+	lib->units = NULL;
+	lib->n_units = 0;
+	lib->key = NULL;
 }
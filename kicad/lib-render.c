@@ -17,6 +17,7 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/hash.h"
 #include "gfx/misc.h"
 #include "gfx/style.h"
 #include "gfx/gfx.h"
@@ -711,18 +712,21 @@ static void draw_text(const struct lib_text *text, struct gfx *gfx,
 /* ----- Lookup and properties --------------------------------------------- */
 
 
+/*
+ * The index only keeps the first component for any name or alias, and we
+ * search the units in order, so the first library containing a name wins.
+ */
+
 const struct comp *lib_find(const struct lib *lib, const char *name)
 {
 	const struct comp *comp;
-	const struct comp_alias *alias;
-
-	for (comp = lib->comps; comp; comp = comp->next) {
-		if (!strcmp(comp->name, name))
-			return comp;
-		for (alias = comp->aliases; alias; alias = alias->next)
-			if (!strcmp(alias->name, name))
-				return comp;
-	}
+	unsigned i;
+
+	comp = hash_lookup(lib->index, name);
+	for (i = 0; !comp && i != lib->n_units; i++)
+		comp = hash_lookup(lib->units[i]->index, name);
+	if (comp)
+		return comp;
 	error("\"%s\" not found", name);
 	return NULL;
 }
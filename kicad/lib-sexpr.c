@@ -0,0 +1,627 @@
+/*
+ * kicad/lib-sexpr.c - Parse KiCad s-expression symbols (.kicad_sym)
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "misc/util.h"
+#include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/intern.h"
+#include "misc/hash.h"
+#include "file/file.h"
+#include "kicad/kicad.h"
+#include "kicad/sexpr.h"
+#include "kicad/sexpr-item.h"
+#include "kicad/lib.h"
+
+
+struct alias {
+	const char *name;
+	const char *base;
+	struct alias *next;
+};
+
+struct lib_sexpr {
+	struct sexpr_ctx *parser;
+	struct sexpr_item *item;
+	bool in_item;
+	bool done;
+	struct alias *aliases;	/* symbols extending symbols we haven't seen
+				   yet; in arena */
+};
+
+
+/* ----- Helpers ----------------------------------------------------------- */
+
+
+static int get_thick(const struct expr *e)
+{
+	double w;
+
+	if (!sexpr_num(sexpr_find(sexpr_find(e, "stroke"), "width"), 0, &w))
+		return 0;
+	return mm_to_mil(w);
+}
+
+
+static char get_fill(const struct expr *e)
+{
+	const char *type = sexpr_arg(sexpr_find(sexpr_find(e, "fill"), "type"),
+	    0);
+
+	if (!type || !strcmp(type, "none"))
+		return 'N';
+	if (!strcmp(type, "outline"))
+		return 'F';
+	if (!strcmp(type, "background"))
+		return 'f';
+	warning("unrecognized fill \"%s\"", type);
+	return 'N';
+}
+
+
+/* ----- Graphical items --------------------------------------------------- */
+
+
+static bool poly(struct lib *lib, struct lib_obj *obj, const struct expr *e)
+{
+	struct lib_poly *poly = &obj->u.poly;
+	const struct expr *pts = sexpr_find(e, "pts");
+	const struct expr *p;
+	double x, y;
+	int n = 0;
+
+	if (!pts)
+		return 0;
+	for (p = pts->next; p; p = p->next)
+		if (p->e && p->e->s && !strcmp(p->e->s, "xy"))
+			n++;
+
+	poly->points = n;
+	poly->x = arena_alloc_type_n(lib->arena, int, n);
+	poly->y = arena_alloc_type_n(lib->arena, int, n);
+	n = 0;
+	for (p = pts->next; p; p = p->next) {
+		if (!p->e || !p->e->s || strcmp(p->e->s, "xy"))
+			continue;
+		if (!sexpr_num(p->e, 0, &x) || !sexpr_num(p->e, 1, &y))
+			return 0;
+		poly->x[n] = mm_to_mil(x);
+		poly->y[n] = mm_to_mil(y);
+		n++;
+	}
+	poly->thick = get_thick(e);
+	poly->fill = get_fill(e);
+	return 1;
+}
+
+
+static bool rect(struct lib_obj *obj, const struct expr *e)
+{
+	struct lib_rect *rect = &obj->u.rect;
+
+	rect->thick = get_thick(e);
+	rect->fill = get_fill(e);
+	return sexpr_xy(e, "start", &rect->sx, &rect->sy) &&
+	    sexpr_xy(e, "end", &rect->ex, &rect->ey);
+}
+
+
+static bool circ(struct lib_obj *obj, const struct expr *e)
+{
+	struct lib_circ *circ = &obj->u.circ;
+	double r;
+
+	if (!sexpr_xy(e, "center", &circ->x, &circ->y) ||
+	    !sexpr_num(sexpr_find(e, "radius"), 0, &r))
+		return 0;
+	circ->r = mm_to_mil(r);
+	circ->thick = get_thick(e);
+	circ->fill = get_fill(e);
+	return 1;
+}
+
+
+static double point_angle(double x, double y, double cx, double cy)
+{
+	double a = atan2(y - cy, x - cx) * 180 / M_PI;
+
+	return a < 0 ? a + 360 : a;
+}
+
+
+static double ccw(double from, double to)
+{
+	return fmod(to - from + 360, 360);
+}
+
+
+/*
+ * Arcs are given by three points. The arc goes counter-clockwise (in the
+ * library's coordinate system, with y up) from start_a to end_a, which lets
+ * it be larger than 180 degrees.
+ */
+
+static bool arc(struct lib_obj *obj, const struct expr *e)
+{
+	struct lib_arc *arc = &obj->u.arc;
+	double ax, ay, mx, my, bx, by;
+	double a2, m2, b2, d, cx, cy;
+	double sa, ma, ea;
+
+	if (!sexpr_num(sexpr_find(e, "start"), 0, &ax) ||
+	    !sexpr_num(sexpr_find(e, "start"), 1, &ay) ||
+	    !sexpr_num(sexpr_find(e, "mid"), 0, &mx) ||
+	    !sexpr_num(sexpr_find(e, "mid"), 1, &my) ||
+	    !sexpr_num(sexpr_find(e, "end"), 0, &bx) ||
+	    !sexpr_num(sexpr_find(e, "end"), 1, &by))
+		return 0;
+
+	d = 2 * (ax * (my - by) + mx * (by - ay) + bx * (ay - my));
+	if (!d)
+		return 0;
+	a2 = ax * ax + ay * ay;
+	m2 = mx * mx + my * my;
+	b2 = bx * bx + by * by;
+	cx = (a2 * (my - by) + m2 * (by - ay) + b2 * (ay - my)) / d;
+	cy = (a2 * (bx - mx) + m2 * (ax - bx) + b2 * (mx - ax)) / d;
+
+	sa = point_angle(ax, ay, cx, cy);
+	ma = point_angle(mx, my, cx, cy);
+	ea = point_angle(bx, by, cx, cy);
+	if (ccw(sa, ma) > ccw(sa, ea))
+		swap(sa, ea);
+
+	arc->x = mm_to_mil(cx);
+	arc->y = mm_to_mil(cy);
+	arc->r = mm_to_mil(hypot(ax - cx, ay - cy));
+	arc->start_a = (int) lround(sa) % 360;
+	arc->end_a = (int) lround(ea) % 360;
+	arc->thick = get_thick(e);
+	arc->fill = get_fill(e);
+	return 1;
+}
+
+
+static bool text(struct lib *lib, struct lib_obj *obj, const struct expr *e)
+{
+	struct lib_text *text = &obj->u.text;
+	const char *s = sexpr_arg(e, 0);
+	bool hidden;
+
+	if (!s || !sexpr_xy(e, "at", &text->x, &text->y))
+		return 0;
+	text->s = intern(s);
+	text->orient = sexpr_angle(e) * 10;
+	sexpr_effects(e, &text->dim, &text->style,
+	    &text->hor_align, &text->vert_align, &hidden);
+	return 1;
+}
+
+
+/* ----- Pins -------------------------------------------------------------- */
+
+
+static char pin_etype(const char *s)
+{
+	static const struct {
+		const char *name;
+		char etype;
+	} types[] = {
+		{ "input",		'I' },
+		{ "output",		'O' },
+		{ "bidirectional",	'B' },
+		{ "tri_state",		'T' },
+		{ "passive",		'P' },
+		{ "unspecified",	'U' },
+		{ "free",		'U' },
+		{ "power_in",		'W' },
+		{ "power_out",		'w' },
+		{ "open_collector",	'C' },
+		{ "open_emitter",	'E' },
+		{ "no_connect",		'N' },
+	};
+	unsigned i;
+
+	for (i = 0; i != ARRAY_ELEMENTS(types); i++)
+		if (!strcmp(s, types[i].name))
+			return types[i].etype;
+	warning("unrecognized pin type \"%s\"", s);
+	return 'U';
+}
+
+
+static enum pin_shape pin_shape(const char *s)
+{
+	if (!strcmp(s, "line"))
+		return 0;
+	if (!strcmp(s, "inverted"))
+		return pin_inverted;
+	if (!strcmp(s, "clock"))
+		return pin_clock;
+	if (!strcmp(s, "inverted_clock"))
+		return pin_clock | pin_inverted;
+	if (!strcmp(s, "input_low"))
+		return pin_input_low;
+	if (!strcmp(s, "clock_low"))
+		return pin_clock | pin_input_low;
+	if (!strcmp(s, "output_low"))
+		return pin_output_low;
+	if (!strcmp(s, "edge_clock_high"))
+		return pin_falling_edge;
+	if (!strcmp(s, "non_logic"))
+		return pin_non_logic;
+	warning("unrecognized pin shape \"%s\"", s);
+	return 0;
+}
+
+
+static const char *pin_text(struct lib *lib, const struct expr *e,
+    const char *kw, int *size)
+{
+	const struct expr *sub = sexpr_find(e, kw);
+	const char *s = sexpr_arg(sub, 0);
+	enum text_style style;
+	char hor, vert;
+	bool hidden;
+
+	sexpr_effects(sub, size, &style, &hor, &vert, &hidden);
+	return intern(s ? s : "");
+}
+
+
+static bool pin(struct lib *lib, struct lib_obj *obj, const struct expr *e)
+{
+	struct lib_pin *pin = &obj->u.pin;
+	const char *etype = sexpr_arg(e, 0);
+	const char *shape = sexpr_arg(e, 1);
+	double len;
+
+	if (!etype || !shape || !sexpr_xy(e, "at", &pin->x, &pin->y) ||
+	    !sexpr_num(sexpr_find(e, "length"), 0, &len))
+		return 0;
+	pin->length = mm_to_mil(len);
+	switch (sexpr_angle(e)) {
+	case 0:
+		pin->orient = 'R';
+		break;
+	case 90:
+		pin->orient = 'U';
+		break;
+	case 180:
+		pin->orient = 'L';
+		break;
+	case 270:
+		pin->orient = 'D';
+		break;
+	default:
+		return 0;
+	}
+	pin->etype = pin_etype(etype);
+	pin->shape = pin_shape(shape);
+	if (sexpr_flag(e, "hide"))
+		pin->shape |= pin_invisible;
+	pin->name = pin_text(lib, e, "name", &pin->name_size);
+	pin->number = pin_text(lib, e, "number", &pin->number_size);
+	return 1;
+}
+
+
+/* ----- Symbols ----------------------------------------------------------- */
+
+
+static void add_item(struct lib *lib, const struct expr *e,
+    unsigned unit, unsigned convert)
+{
+	struct lib_obj *obj;
+	bool ok;
+
+	obj = arena_alloc_type(lib->arena, struct lib_obj);
+	obj->unit = unit;
+	obj->convert = convert;
+	obj->next = NULL;
+
+	if (!strcmp(e->s, "polyline")) {
+		obj->type = lib_obj_poly;
+		ok = poly(lib, obj, e);
+	} else if (!strcmp(e->s, "rectangle")) {
+		obj->type = lib_obj_rect;
+		ok = rect(obj, e);
+	} else if (!strcmp(e->s, "circle")) {
+		obj->type = lib_obj_circ;
+		ok = circ(obj, e);
+	} else if (!strcmp(e->s, "arc")) {
+		obj->type = lib_obj_arc;
+		ok = arc(obj, e);
+	} else if (!strcmp(e->s, "text")) {
+		obj->type = lib_obj_text;
+		ok = text(lib, obj, e);
+	} else if (!strcmp(e->s, "pin")) {
+		obj->type = lib_obj_pin;
+		ok = pin(lib, obj, e);
+	} else {
+		return;
+	}
+	if (!ok) {
+		warning("%s: cannot parse %s", lib->curr_comp->name, e->s);
+		return;
+	}
+
+	*lib->next_obj = obj;
+	lib->next_obj = &obj->next;
+}
+
+
+/*
+ * The drawings of a symbol are in sub-symbols named name_unit_convert, where
+ * 0 means that the item applies to all units or to both representations.
+ */
+
+static void add_unit(struct lib *lib, const struct expr *e)
+{
+	const char *name = sexpr_arg(e, 0);
+	const char *p;
+	unsigned unit = 0, convert = 0;
+	const struct expr *sub;
+
+	p = name ? strrchr(name, '_') : NULL;
+	if (p) {
+		convert = atoi(p + 1);
+		while (--p != name && *p != '_');
+		unit = atoi(p + 1);
+	}
+	if (unit > lib->curr_comp->units)
+		lib->curr_comp->units = unit;
+
+	for (sub = e->next; sub; sub = sub->next)
+		if (sub->e && sub->e->s)
+			add_item(lib, sub->e, unit, convert);
+}
+
+
+/*
+ * Fields have an "id" in KiCad 6, and are only identified by their name in
+ * later versions.
+ */
+
+static int field_id(const struct expr *e, unsigned *next)
+{
+	static const char *names[] = {
+		"Reference", "Value", "Footprint", "Datasheet"
+	};
+	const char *name = sexpr_arg(e, 0);
+	double id;
+	unsigned i;
+
+	if (sexpr_num(sexpr_find(e, "id"), 0, &id))
+		return id;
+	for (i = 0; i != ARRAY_ELEMENTS(names); i++)
+		if (name && !strcmp(name, names[i]))
+			return i;
+	return (*next)++;
+}
+
+
+static void add_symbol(struct lib *lib, const char *name,
+    const struct expr *e)
+{
+	const struct expr *pin_names = sexpr_find(e, "pin_names");
+	const struct expr *pin_numbers = sexpr_find(e, "pin_numbers");
+	bool power = sexpr_find(e, "power");
+	struct comp *comp;
+	const struct expr *sub;
+	unsigned next_field = 4;
+	enum text_style style;
+	char hor, vert;
+	bool hidden;
+	double offset;
+	int size, id;
+
+	comp = arena_alloc_type(lib->arena, struct comp);
+	comp->name = intern(name);
+	hash_insert(lib->index, comp->name, comp);
+	comp->aliases = NULL;
+	comp->units = 1;
+
+	comp->visible = 0;
+	comp->show_pin_name = !sexpr_flag(pin_names, "hide") && !power;
+	comp->show_pin_num = !sexpr_flag(pin_numbers, "hide") && !power;
+	comp->name_offset = 40;
+	if (sexpr_num(sexpr_find(pin_names, "offset"), 0, &offset))
+		comp->name_offset = mm_to_mil(offset);
+
+	comp->objs = NULL;
+	lib->next_obj = &comp->objs;
+	lib->curr_comp = comp;
+
+	comp->next = NULL;
+	*lib->next_comp = comp;
+	lib->next_comp = &comp->next;
+
+	for (sub = e->next; sub; sub = sub->next) {
+		if (!sub->e || !sub->e->s)
+			continue;
+		if (!strcmp(sub->e->s, "property")) {
+			id = field_id(sub->e, &next_field);
+			sexpr_effects(sub->e, &size, &style, &hor, &vert,
+			    &hidden);
+			if (!hidden && id >= 0 && id < 32)
+				comp->visible |= 1 << id;
+		} else if (!strcmp(sub->e->s, "symbol")) {
+			add_unit(lib, sub->e);
+		} else {
+			add_item(lib, sub->e, 0, 0);
+		}
+	}
+}
+
+
+static bool add_alias(struct lib *lib, const char *name, const char *base)
+{
+	struct comp *comp;
+
+	comp = hash_lookup(lib->index, base);
+	if (!comp)
+		return 0;
+	lib_add_alias(lib, comp, name, strlen(name));
+	return 1;
+}
+
+
+/*
+ * Symbols that extend another symbol share its drawings, like aliases in the
+ * legacy format. We ignore any fields they override.
+ */
+
+void lib_sexpr_symbol(struct lib *lib, const struct expr *e)
+{
+	const char *name = sexpr_arg(e, 0);
+	const char *base = sexpr_arg(sexpr_find(e, "extends"), 0);
+	struct alias *alias;
+
+	if (!name) {
+		warning("symbol without name");
+		return;
+	}
+	if (!base) {
+		add_symbol(lib, name, e);
+		return;
+	}
+	if (add_alias(lib, name, base))
+		return;
+	if (!lib->sexpr) {
+		warning("%s: base symbol \"%s\" not found", name, base);
+		return;
+	}
+	alias = arena_alloc_type(lib->arena, struct alias);
+	alias->name = arena_strdup(lib->arena, name);
+	alias->base = arena_strdup(lib->arena, base);
+	alias->next = lib->sexpr->aliases;
+	lib->sexpr->aliases = alias;
+}
+
+
+/* ----- Library files ----------------------------------------------------- */
+
+
+/*
+ * .kicad_sym files are streamed, with each symbol (a list at depth 2) built as
+ * an item of its own.
+ */
+
+static bool lib_enter(void *user, unsigned depth)
+{
+	struct lib *lib = user;
+	struct lib_sexpr *sx = lib->sexpr;
+
+	if (sx->in_item)
+		sexpr_item_enter(sx->item);
+	else if (depth == 2) {
+		sx->in_item = 1;
+		sexpr_item_begin(sx->item);
+	}
+	return 1;
+}
+
+
+static bool lib_atom(void *user, const char *s, unsigned depth)
+{
+	struct lib *lib = user;
+	struct lib_sexpr *sx = lib->sexpr;
+
+	if (sx->in_item)
+		sexpr_item_atom(sx->item, s);
+	return 1;
+}
+
+
+static bool lib_leave(void *user, unsigned depth)
+{
+	struct lib *lib = user;
+	struct lib_sexpr *sx = lib->sexpr;
+	const struct expr *e;
+
+	if (depth == 1) {
+		sx->done = 1;
+		return 1;
+	}
+	if (!sx->in_item || !sexpr_item_leave(sx->item))
+		return 1;
+	sx->in_item = 0;
+	e = sexpr_item_expr(sx->item);
+	if (e && e->s && !strcmp(e->s, "symbol"))
+		lib_sexpr_symbol(lib, e);
+	return 1;
+}
+
+
+void lib_sexpr_free(struct lib *lib)
+{
+	struct lib_sexpr *sx = lib->sexpr;
+
+	if (!sx)
+		return;
+	sexpr_free(sx->parser);
+	sexpr_item_free(sx->item);
+	free(sx);
+	lib->sexpr = NULL;
+}
+
+
+static void end_lib(struct lib *lib)
+{
+	const struct alias *alias;
+
+	for (alias = lib->sexpr->aliases; alias; alias = alias->next)
+		if (!add_alias(lib, alias->name, alias->base))
+			warning("%s: base symbol \"%s\" not found",
+			    alias->name, alias->base);
+	lib_sexpr_free(lib);
+	lib->state = lib_skip;
+}
+
+
+/*
+ * Lines are passed with their newline, so that a word at the end of a line
+ * doesn't run into the next one.
+ */
+
+bool lib_sexpr_parse_line(struct lib *lib, const char *line)
+{
+	static const struct sexpr_ops ops = {
+		.enter	= lib_enter,
+		.atom	= lib_atom,
+		.leave	= lib_leave,
+	};
+	struct lib_sexpr *sx = lib->sexpr;
+
+	if (!sx) {
+		sx = alloc_type(struct lib_sexpr);
+		sx->parser = sexpr_new_stream(&ops, lib);
+		sx->item = sexpr_item_new();
+		sx->in_item = 0;
+		sx->done = 0;
+		sx->aliases = NULL;
+		lib->sexpr = sx;
+	}
+	if (!sexpr_parse(sx->parser, line) || !sexpr_parse(sx->parser, "\n"))
+		return 0;
+	if (!sx->done)
+		return 1;
+	if (!sexpr_finish(sx->parser, NULL))
+		return 0;
+	end_lib(lib);
+	return 1;
+}
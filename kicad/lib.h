@@ -19,6 +19,7 @@
 #include "file/file.h"
 #include "gfx/text.h"
 #include "gfx/gfx.h"
+#include "misc/arena.h"
 #include "kicad/ext.h"
 
 
@@ -36,6 +37,7 @@ enum lib_state {
 	lib_skip,	/* before a definition */
 	lib_def,	/* in definition */
 	lib_draw,	/* in drawings */
+	lib_sexpr,	/* in a .kicad_sym file */
 };
 
 struct lib_obj {
@@ -80,14 +82,14 @@ struct lib_obj {
 			int orient;
 			int x, y;
 			int dim;
-			char *s;
+			const char *s;
 			enum text_style style;
 			char hor_align;
 			char vert_align;
 		} text;
 		struct lib_pin {
-			char *name;
-			char *number;
+			const char *name;
+			const char *number;
 			int x, y;
 			int length;
 			char orient;
@@ -122,7 +124,21 @@ struct comp {
 struct lib {
 	enum lib_state state;
 
+	struct arena *arena;	/* all components and their objects */
 	struct comp *comps;
+	struct hash *index;	/* name or alias to component, in arena */
+
+	/*
+	 * Libraries searched after our own components, in this order. Each
+	 * has its own arena, which is attached to ours.
+	 */
+	const struct lib **units; /* in arena */
+	unsigned n_units;
+
+	const char *key;	/* OID of the file of a unit, for the disk
+				   cache; in arena, NULL if unknown */
+
+	struct lib_sexpr *sexpr; /* .kicad_sym parser state; NULL if none */
 
 	struct comp *curr_comp; /* current component */
 	struct comp **next_comp;
@@ -130,6 +146,8 @@ struct lib {
 };
 
 
+struct expr;
+
 extern struct comp *comps;
 
 
@@ -137,13 +155,22 @@ const struct comp *lib_find(const struct lib *lib, const char *name);
 void lib_render(const struct comp *comp, struct gfx *gfx,
     unsigned unit, unsigned convert, const int m[6]);
 
+void lib_add_alias(struct lib *lib, struct comp *comp, const char *alias,
+    unsigned len);
+
+void lib_sexpr_symbol(struct lib *lib, const struct expr *e);
+bool lib_sexpr_parse_line(struct lib *lib, const char *line);
+void lib_sexpr_free(struct lib *lib);
+
 bool lib_parse_file(struct lib *lib, struct file *file);
+bool lib_parse_files(struct lib *lib, struct file *files, unsigned n);
 bool lib_parse(struct lib *lib, const char *name, const struct file *related);
 bool lib_find_file(struct file *file, const char *name,
     const struct file_names *fn, const struct file *related);
 bool lib_parse_search(struct lib *lib, const char *name,
     const struct file_names *fn, const struct file *related);
 void lib_init(struct lib *lib);
+void lib_share(struct lib *lib, const struct lib *from);
 void lib_free(struct lib *lib);
 
 #endif /* !KICAD_LIB_H */
@@ -492,21 +492,20 @@ static struct pl_ctx *new_pl_ctx(void)
 struct pl_ctx *pl_parse(struct file *file)
 {
 	struct pl_ctx *pl = new_pl_ctx();
-	struct expr *e = NULL;
+	struct expr *e;
 
-	if (!file_read(file, pl_parse_line, pl)) {
-		sexpr_abort(pl->sexpr_ctx);
+	if (!file_read(file, pl_parse_line, pl))
 		goto fail;
-	}
 	if (!sexpr_finish(pl->sexpr_ctx, &e))
 		goto fail;
 	if (!process(pl, e))
 		goto fail;
-	free_expr(e);
+	sexpr_free(pl->sexpr_ctx);
+	pl->sexpr_ctx = NULL;
 	return pl;
 
 fail:
-	free_expr(e);
+	sexpr_free(pl->sexpr_ctx);
 	free(pl);
 	return 0;
 }
@@ -528,13 +527,14 @@ static struct pl_ctx *default_pl(void)
 {
 #include "../pl-default.inc"
 	struct pl_ctx *pl = new_pl_ctx();
-	struct expr *e = NULL;
+	struct expr *e;
 
 	if (!sexpr_parse(pl->sexpr_ctx, defaultPageLayout) ||
 	    !sexpr_finish(pl->sexpr_ctx, &e) ||
 	    !process(pl, e))
 		BUG("cannot parse default layout");
-	free_expr(e);
+	sexpr_free(pl->sexpr_ctx);
+	pl->sexpr_ctx = NULL;
 	return pl;
 }
 
@@ -13,6 +13,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -21,10 +22,17 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
+#include "misc/pool.h"
+#include "misc/intern.h"
 #include "kicad/dwg.h"
+#include "kicad/tok.h"
 #include "file/file.h"
 #include "kicad/lib.h"
 #include "kicad/sch.h"
+#include "kicad/cache.h"
+#include "kicad/disk-cache.h"
 
 
 /* ----- Helper functions -------------------------------------------------- */
@@ -51,42 +59,34 @@ static const char *sanitize_file_name(const char *name)
 /* ----- (Global) Labels --------------------------------------------------- */
 
 
-static enum dwg_shape do_decode_shape(const char *s)
+static enum dwg_shape decode_shape(const char *s, unsigned len)
 {
-	if (!strcmp(s, "UnSpc"))
+	if (tok_eq(s, len, "UnSpc"))
 		return dwg_unspec;
-	if (!strcmp(s, "Input"))
+	if (tok_eq(s, len, "Input"))
 		return dwg_in;
-	if (!strcmp(s, "Output"))
+	if (tok_eq(s, len, "Output"))
 		return dwg_out;
-	if (!strcmp(s, "3State"))
+	if (tok_eq(s, len, "3State"))
 		return dwg_tri;
-	if (!strcmp(s, "BiDi"))
+	if (tok_eq(s, len, "BiDi"))
 		return dwg_bidir;
-	fatal("unknown shape: \"%s\"", s);
+	fatal("unknown shape: \"%.*s\"", (int) len, s);
 }
 
 
-static enum dwg_shape decode_shape(const char *s)
-{
-	enum dwg_shape res;
-
-	res = do_decode_shape(s);
-	free((void *) s);
-	return res;
-}
-
-
-static enum text_style decode_style(const char *italic, int bold)
+static enum text_style decode_style(const char *italic, unsigned len,
+    int bold)
 {
 	enum text_style res;
 
-	if (!strcmp(italic, "~"))
+	if (tok_eq(italic, len, "~"))
 		res = text_normal;
-	else if (!strcmp(italic, "Italic"))
+	else if (tok_eq(italic, len, "Italic"))
 		res = text_italic;
 	else {
-		error ("unrecognized text attribute \"%s\"", italic);
+		error ("unrecognized text attribute \"%.*s\"",
+		    (int) len, italic);
 		res = text_normal;
 	}
 
@@ -132,69 +132,44 @@ void decode_alignment(struct text *txt, char hor, char vert)
 }
 
 
-static bool parse_field(struct sch_ctx *ctx, const char *line)
+/*
+ * F n "text" orientation x y size flags hor vert+italic+bold
+ */
+
+static bool parse_field(struct sch_ctx *ctx, struct tok *tok)
 {
 	struct sch_comp *comp = &ctx->obj.u.comp;
 	unsigned flags;
 	char hv, hor, vert, italic = 'N', bold = 'N';
+	struct comp_field tmp;
 	struct comp_field *field;
-	struct text *txt;
-	char *s;
-	const char *p;
-	int pos = 0, len;
+	struct text *txt = &tmp.txt;
+	const char *s;
+	unsigned len;
 
-	field = alloc_type(struct comp_field);
-	txt = &field->txt;
-	txt->s = NULL;
+	if (!tok_unsigned(tok, &tmp.n) || !tok_str(tok, &s, &len))
+		return 0;
+	if (!tok_char(tok, &hv) || !tok_int(tok, &txt->x) ||
+	    !tok_int(tok, &txt->y) || !tok_int(tok, &txt->size) ||
+	    !tok_unsigned(tok, &flags) ||
+	    !tok_char(tok, &hor) || !tok_char(tok, &vert))
+		return 0;
+	if (tok_next_char(tok, &italic))
+		tok_next_char(tok, &bold);
 
 	/* ignore fields with empty string as content */
-	if (sscanf(line, "F %u \"\" %c %d %d %u %u %c %c%c%c",
-	    &field->n, &hv, &txt->x, &txt->y, &txt->size, &flags, &hor, &vert,
-	    &italic, &bold) >= 8) {
-		free(field);
+	if (!len)
 		return 1;
-	}
 
-	if (sscanf(line, "F %u \"%n", &field->n, &pos) != 1 || !pos) {
-		free(field);
-		return 0;
-	}
-	for (p = line + pos; *p && *p != '"'; p++)
-		if (*p == '\\' && p[1])
-			p++;
-	if (*p != '"') {
-		free(field);
-		return 0;
-	}
+	field = arena_alloc_type(ctx->arena, struct comp_field);
+	*field = tmp;
+	txt = &field->txt;
 
-	len = p - (line + pos);
-	s = alloc_size(len + 1);
-	memcpy(s, line + pos, len);
-	s[len] = 0;
-
-	if (sscanf(p + 1, " %c %d %d %u %u %c %c%c%c",
-	    &hv, &txt->x, &txt->y, &txt->size, &flags,
-	    &hor, &vert, &italic, &bold) < 7) {
-		free(s);
-		free(field);
-		return 0;
-	}
-	txt->s = s;
+	/* the unit suffix of the reference is added when rendering */
+	txt->s = intern_n(s, len);
 
 	field->visible = !flags;
 
-	if (field->n == 0 && comp->comp && comp->comp->units > 1) {
-		len = strlen(txt->s);
-		s = realloc_size((void *) txt->s, len + 3);
-		if (comp->unit <= 26)
-			sprintf(s + len, "%c", 'A' + comp->unit - 1);
-		else
-			sprintf(s + len, "%c%c",
-			    'A' + (comp->unit - 1) / 26 - 1,
-			    'A' + (comp->unit - 1) % 26);
-		txt->s = s;
-	}
-
 	field->next = comp->fields;
 	comp->fields = field;
 
@@ -264,15 +239,25 @@ static int decode_side(char side)
 }
 
 
-static bool parse_hsheet_field(struct sch_ctx *ctx, const char *line)
+/*
+ * F0 "name" size
+ * F1 "file" size
+ * Fn "label" form side x y size	(n >= 2)
+ */
+
+static bool parse_hsheet_field(struct sch_ctx *ctx, struct tok *tok)
 {
 	struct sch_sheet *sheet = &ctx->obj.u.sheet;
-	char *s;
+	const char *p, *s;
 	char form, side;
-	unsigned n, dim;
+	unsigned len, dim;
+	int n, x, y;
 	struct sheet_field *field;
 
-	if (sscanf(line, "F%d \"%m[^\"]\" %u", &n, &s, &dim) == 3) {
+	if (!tok_int(tok, &n) || !tok_str(tok, &p, &len))
+		return 0;
+	if (tok_unsigned(tok, &dim)) {
+		s = intern_n(p, len);
 		switch (n) {
 		case 0:
 			sheet->name = s;
@@ -287,15 +272,17 @@ static bool parse_hsheet_field(struct sch_ctx *ctx, const char *line)
 		}
 	}
 
-	field = alloc_type(struct sheet_field);
-	if (sscanf(line, "F%d \"%m[^\"]\" %c %c %d %d %u",
-	    &n, &field->s, &form, &side, &field->x, &field->y, &field->dim)
-	    != 7) {
-		free(field);
+	if (!tok_char(tok, &form) || !tok_char(tok, &side) ||
+	    !tok_int(tok, &x) || !tok_int(tok, &y) || !tok_unsigned(tok, &dim))
 		return 0;
-	}
 	assert(n >= 2);
 
+	field = arena_alloc_type(ctx->arena, struct sheet_field);
+	field->s = intern_n(p, len);
+	field->x = x;
+	field->y = y;
+	field->dim = dim;
+
 	if (side == 'B' || side == 'T') {
 		/*
 		 * This is beautiful: since there is no indication for rotation
@@ -326,20 +313,23 @@ static bool parse_hsheet_field(struct sch_ctx *ctx, const char *line)
 /* ----- Comments ---------------------------------------------------------- */
 
 
-static void add_comment(struct sheet *sheet, unsigned n, char *s)
+void sch_add_comment(struct sch_ctx *ctx, struct sheet *sheet, unsigned n,
+    const char *s)
 {
+	const char **comments;
 	unsigned i;
 
 	if (n >= sheet->n_comments) {
-		sheet->comments =
-		    realloc_type_n(sheet->comments, const char *, n + 1);
-		for (i = sheet->n_comments; i <= n; i++)
-			sheet->comments[i] = NULL;
+		comments = arena_alloc_type_n(ctx->arena, const char *, n + 1);
+		for (i = 0; i != sheet->n_comments; i++)
+			comments[i] = sheet->comments[i];
+		for (; i <= n; i++)
+			comments[i] = NULL;
+		sheet->comments = comments;
 		sheet->n_comments = n + 1;
 	}
 	if (sheet->comments[n]) {
 		warning("duplicate comment %d", n);
-		free(s);
 		return;
 	}
 	sheet->comments[n] = s;
@@ -349,11 +339,11 @@ static void add_comment(struct sheet *sheet, unsigned n, char *s)
 /* ----- Schematics parser ------------------------------------------------- */
 
 
-static struct sch_obj *submit_obj(struct sch_ctx *ctx, enum sch_obj_type type)
+struct sch_obj *sch_submit_obj(struct sch_ctx *ctx, enum sch_obj_type type)
 {
 	struct sch_obj *obj;
 
-	obj = alloc_type(struct sch_obj);
+	obj = arena_alloc_type(ctx->arena, struct sch_obj);
 	*obj = ctx->obj;
 	obj->type = type;
 	obj->next = NULL;
@@ -365,33 +355,56 @@ static struct sch_obj *submit_obj(struct sch_ctx *ctx, enum sch_obj_type type)
 }
 
 
-static struct sheet *new_sheet(struct sch_ctx *ctx)
+static struct sheet *alloc_sheet(struct sch_ctx *ctx)
 {
 	struct sheet *sheet;
 
-	sheet = alloc_type(struct sheet);
+	sheet = arena_alloc_type(ctx->arena, struct sheet);
 	sheet->title = NULL;
 	sheet->file = NULL;
 	sheet->mtime = 0;
+	sheet->dev = 0;
+	sheet->ino = 0;
 	sheet->path = NULL;
 	sheet->objs = NULL;
+	sheet->objs_arena = NULL;
 	sheet->next_obj = &sheet->objs;
 	sheet->next = NULL;
 
 	sheet->size = NULL;
 	sheet->w = sheet->h = 0;
+	sheet->date = sheet->rev = sheet->comp = NULL;
 	sheet->comments = NULL;
 	sheet->n_comments = 0;
 
 	sheet->has_children = 0;
 
+	sheet->lib = ctx->lib;
+	sheet->syms = NULL;
+	sheet->n_syms = 0;
+	sheet->comps = NULL;
+	sheet->embedded = NULL;
+
 	sheet->oid = NULL;
 
-	ctx->curr_sheet = sheet;
+	return sheet;
+}
+
 
+static void add_sheet(struct sch_ctx *ctx, struct sheet *sheet)
+{
 	*ctx->next_sheet = sheet;
 	ctx->next_sheet = &sheet->next;
+}
+
 
+static struct sheet *new_sheet(struct sch_ctx *ctx)
+{
+	struct sheet *sheet;
+
+	sheet = alloc_sheet(ctx);
+	ctx->curr_sheet = sheet;
+	add_sheet(ctx, sheet);
 	return sheet;
 }
 
@@ -399,75 +412,619 @@ static struct sheet *new_sheet(struct sch_ctx *ctx)
 static bool parse_line(const struct file *file, void *user, const char *line);
 
 
+/*
+ * A .kicad_sch file that ends before its last list is closed leaves the
+ * streaming parser behind.
+ */
+
+static bool read_sheet(struct sch_ctx *ctx, struct file *file)
+{
+	bool ok;
+
+	ok = file_read(file, parse_line, ctx);
+	if (ctx->sexpr) {
+		if (ok)
+			error("%s: unexpected end of file", file->name);
+		sch_sexpr_free(ctx);
+		return 0;
+	}
+	return ok;
+}
+
+
+/* ----- Symbols ----------------------------------------------------------- */
+
+
+/*
+ * We don't look up components while parsing, so the objects don't depend on
+ * the library. Instead, each sheet records the symbols it uses, and each
+ * component the index of its symbol. sch_find_comp then resolves components
+ * on demand.
+ */
+
+static void alloc_comps(struct sch_ctx *ctx, struct sheet *sheet)
+{
+	sheet->comps = arena_alloc_type_n(ctx->arena, const struct comp *,
+	    sheet->n_syms);
+	memset(sheet->comps, 0, sizeof(const struct comp *) * sheet->n_syms);
+}
+
+
+static void index_syms(struct sch_ctx *ctx, struct sheet *sheet)
+{
+	struct hash *index = hash_new(NULL, hash_str, hash_str_eq);
+	struct sch_obj *obj;
+	uintptr_t sym;
+	unsigned n = 0;
+
+	for (obj = sheet->objs; obj; obj = obj->next) {
+		if (obj->type != sch_obj_comp || !obj->u.comp.name)
+			continue;
+		sym = (uintptr_t) hash_lookup(index, obj->u.comp.name);
+		if (!sym) {
+			sym = ++n;
+			hash_insert(index, obj->u.comp.name, (void *) sym);
+		}
+		obj->u.comp.sym = sym - 1;
+	}
+	hash_free(index);
+
+	sheet->syms = arena_alloc_type_n(ctx->arena, const char *, n);
+	sheet->n_syms = n;
+	for (obj = sheet->objs; obj; obj = obj->next)
+		if (obj->type == sch_obj_comp && obj->u.comp.name)
+			sheet->syms[obj->u.comp.sym] = obj->u.comp.name;
+	alloc_comps(ctx, sheet);
+}
+
+
+/* ----- Sheets instantiated more than once -------------------------------- */
+
+
+/*
+ * A sheet file that appears several times in the hierarchy is only parsed
+ * once. Further instances get their own struct sheet (for path and title) but
+ * share the objects of the first one.
+ *
+ * We only do this for sheets without sub-sheets, since the sheet objects of a
+ * parent point to the sheets of that particular instance.
+ *
+ * Sheets are identified by the OID of their blob if they come from git, and
+ * by device, inode, and modification time otherwise.
+ */
+
+static unsigned sheet_hash(const void *key)
+{
+	const struct sheet *sheet = key;
+
+	if (sheet->oid)
+		return file_oid_hash(sheet->oid);
+	return (sheet->dev * 31 + sheet->ino) * 31 + sheet->mtime;
+}
+
+
+static bool sheet_eq(const void *a, const void *b)
+{
+	const struct sheet *sa = a;
+	const struct sheet *sb = b;
+
+	if (sa->oid || sb->oid)
+		return file_oid_eq(sa->oid, sb->oid);
+	return sa->ino && sa->dev == sb->dev && sa->ino == sb->ino &&
+	    sa->mtime == sb->mtime;
+}
+
+
+static bool is_leaf(const struct sheet *sheet)
+{
+	const struct sch_obj *obj;
+
+	for (obj = sheet->objs; obj; obj = obj->next)
+		if (obj->type == sch_obj_sheet)
+			return 0;
+	return 1;
+}
+
+
+static void remember_sheet(struct sch_ctx *ctx, struct sheet *sheet,
+    bool parsed)
+{
+	if (!is_leaf(sheet))
+		return;
+	hash_insert(ctx->parsed, sheet, sheet);
+	cache_add_sheet(sheet, ctx->arena);
+	if (parsed)
+		disk_cache_store_sheet(sheet);
+}
+
+
+static void share_sheet(struct sch_ctx *ctx, struct sheet *sheet,
+    const struct sheet *other)
+{
+	sheet->title = other->title;
+	sheet->objs = other->objs;
+	sheet->objs_arena =
+	    other->objs_arena ? arena_ref(other->objs_arena) : NULL;
+	sheet->size = other->size;
+	sheet->w = other->w;
+	sheet->h = other->h;
+	sheet->date = other->date;
+	sheet->rev = other->rev;
+	sheet->comp = other->comp;
+	sheet->comments = other->comments;
+	sheet->n_comments = other->n_comments;
+	sheet->syms = other->syms;
+	sheet->n_syms = other->n_syms;
+	sheet->embedded = other->embedded;
+	alloc_comps(ctx, sheet);
+}
+
+
+/*
+ * Sheets we have already parsed in this context take precedence over those
+ * in the process-wide cache, which in turn take precedence over the disk
+ * cache.
+ */
+
+static bool reuse_sheet(struct sch_ctx *ctx, struct sheet *sheet)
+{
+	const struct sheet *other;
+
+	other = hash_lookup(ctx->parsed, sheet);
+	if (other) {
+		progress(2, "%s: already parsed", sheet->file);
+	} else {
+		other = cache_sheet(sheet->oid);
+		if (!other) {
+			if (!disk_cache_load_sheet(sheet, ctx->arena))
+				return 0;
+			index_syms(ctx, sheet);
+			remember_sheet(ctx, sheet, 0);
+			return 1;
+		}
+		progress(2, "%s: cached", sheet->file);
+	}
+	share_sheet(ctx, sheet, other);
+	return 1;
+}
+
+
+/* ----- Sub-sheets -------------------------------------------------------- */
+
+
+/*
+ * Open the file of a sub-sheet and set up its sheet. If we have already
+ * parsed the same file, we borrow its objects and set "borrowed".
+ */
+
+static struct sheet *open_sheet(struct sch_ctx *ctx, struct file *file,
+    const struct sheet *parent, const struct sch_sheet *ref,
+    const struct file *related, bool *borrowed)
+{
+	const char *sheet_name = ref->name ? ref->name : "";
+	struct sheet *sheet;
+	char *tmp;
+
+	*borrowed = 0;
+	if (!file_open(file, ref->file, related))
+		return NULL;
+
+	sheet = alloc_sheet(ctx);
+	// should get what file_open really uses @@@
+	sheet->file = intern(sanitize_file_name(file->name));
+	sheet->mtime = file->mtime;
+	sheet->dev = file->dev;
+	sheet->ino = file->ino;
+	alloc_printf(&tmp, "%s%s/", parent->path, sheet_name);
+	sheet->path = intern(tmp);
+	free(tmp);
+	sheet->oid = file_oid(file);
+
+	*borrowed = reuse_sheet(ctx, sheet);
+	return sheet;
+}
+
+
 static struct sheet *recurse_sheet(struct sch_ctx *ctx,
     const struct file *related)
 {
-	const char *name = ctx->obj.u.sheet.file;
 	struct sheet *parent, *sheet;
 	struct file file;
-	char *tmp;
-	void *oid;
+	bool borrowed;
 	bool res;
 
-	if (!file_open(&file, name, related))
-		return NULL;
-
 	parent = ctx->curr_sheet;
-	sheet = new_sheet(ctx);
-	// should get what file_open really uses @@@
-	sheet->file = stralloc(sanitize_file_name(file.name));
-	sheet->mtime = file.mtime;
-	alloc_printf(&tmp, "%s%s/", parent->path,
-	    ctx->obj.u.sheet.name ? ctx->obj.u.sheet.name : "");
-	sheet->path = tmp;
-	oid = file_oid(&file);
-	sheet->oid = oid;
-
-	if (ctx->prev && oid) {
-		const struct sheet *other;
-
-		for (other = ctx->prev->sheets; other; other = other->next)
-			if (!other->has_children &&
-			    file_oid_eq(other->oid, oid)) {
-				ctx->curr_sheet = parent;
-				sheet->title = stralloc(other->title);
-				sheet->objs = other->objs;
-				sheet->w = other->w;
-				sheet->h = other->h;
-				return sheet;
-			}
+	sheet = open_sheet(ctx, &file, parent, &ctx->obj.u.sheet, related,
+	    &borrowed);
+	if (!sheet)
+		return NULL;
+	add_sheet(ctx, sheet);
+	if (borrowed) {
+		file_close(&file);
+		return sheet;
 	}
 
+	ctx->curr_sheet = sheet;
 	ctx->state = sch_descr;
-	res = file_read(&file, parse_line, ctx);
+	res = read_sheet(ctx, &file);
 	file_close(&file);
+	ctx->curr_sheet = parent;
 	if (!res)
 		return NULL;	/* leave it to caller to clean up */
 
-	ctx->curr_sheet = parent;
+	index_syms(ctx, sheet);
+	remember_sheet(ctx, sheet, 1);
 	parent->has_children = 1;
 
 	return sheet;
 }
 
 
+/* ----- Parallel parsing of sub-sheets ------------------------------------ */
+
+
+/*
+ * When parsing in parallel, we only record sub-sheets while parsing a sheet.
+ * Once a sheet is done, its sub-sheets are opened (in the main thread) and
+ * then parsed by the worker pool, each with a context of its own. Finally,
+ * we link all the sheets in the order the serial parser would have added
+ * them.
+ *
+ * If a sheet file is already being parsed, we wait for the next round and
+ * then try to reuse the result.
+ */
+
+struct sch_job {
+	struct sch_obj *sheet_obj;	/* object referencing the sub-sheet */
+	struct sheet *parent;
+	const struct file *related;
+
+	struct file file;
+	struct sheet *sheet;		/* NULL if we couldn't open it */
+	bool parse;			/* 0 if borrowed */
+	bool deferred;			/* try again in the next round */
+	bool ok;			/* parsed successfully */
+	struct sch_ctx ctx;		/* for parsing the sub-sheet */
+
+	struct sch_job *next;
+};
+
+
+static void add_job(struct sch_ctx *ctx, struct sch_obj *sheet_obj,
+    const struct file *related)
+{
+	struct sch_job *job;
+
+	job = alloc_type(struct sch_job);
+	job->sheet_obj = sheet_obj;
+	job->parent = ctx->curr_sheet;
+	job->related = related;
+	job->sheet = NULL;
+	job->parse = 0;
+	job->deferred = 0;
+	job->ok = 0;
+	job->next = NULL;
+
+	*ctx->next_job = job;
+	ctx->next_job = &job->next;
+}
+
+
+static void init_job_ctx(struct sch_ctx *ctx, const struct sch_ctx *parent,
+    struct sheet *sheet)
+{
+	ctx->state = sch_descr;
+	ctx->arena = arena_new();
+	ctx->recurse = 1;
+	ctx->parallel = 1;
+	ctx->curr_sheet = sheet;
+	ctx->sheets = NULL;
+	ctx->next_sheet = &ctx->sheets;
+	ctx->jobs = NULL;
+	ctx->next_job = &ctx->jobs;
+	ctx->lib = parent->lib;
+	ctx->parsed = NULL;
+	ctx->sexpr = NULL;
+}
+
+
+static void parse_job(void *user)
+{
+	struct sch_job *job = user;
+
+	job->ok = read_sheet(&job->ctx, &job->file);
+}
+
+
+static void start_job(struct sch_ctx *ctx, struct pool *pool,
+    struct hash *busy, struct sch_job *job)
+{
+	bool borrowed;
+
+	if (!job->deferred) {
+		job->sheet = open_sheet(ctx, &job->file, job->parent,
+		    &job->sheet_obj->u.sheet, job->related, &borrowed);
+		if (!job->sheet || borrowed)
+			return;
+	} else if (reuse_sheet(ctx, job->sheet)) {
+		job->deferred = 0;
+		return;
+	}
+
+	job->deferred = hash_lookup(busy, job->sheet);
+	if (job->deferred)
+		return;
+	hash_insert(busy, job->sheet, job->sheet);
+	job->parse = 1;
+	init_job_ctx(&job->ctx, ctx, job->sheet);
+	pool_add(pool, parse_job, job);
+}
+
+
+/*
+ * Update the referencing object and the parent as recurse_sheet and
+ * parse_line would have done.
+ */
+
+static void finish_job(struct sch_ctx *ctx, struct sch_job *job)
+{
+	struct sch_sheet *ref = &job->sheet_obj->u.sheet;
+
+	if (job->parse) {
+		arena_attach(ctx->arena, job->ctx.arena);
+		arena_unref(job->ctx.arena);
+	}
+	if (!job->sheet || (job->parse && !job->ok)) {
+		ref->error = 1;
+		ref->sheet = NULL;
+		return;
+	}
+	if (job->parse) {
+		job->parent->has_children = 1;
+		index_syms(ctx, job->sheet);
+		remember_sheet(ctx, job->sheet, 1);
+	}
+	if (ref->name)
+		job->sheet->title = ref->name;
+	ref->sheet = job->sheet;
+}
+
+
+static void link_sheets(struct sch_ctx *ctx, const struct sch_job *job)
+{
+	for (; job; job = job->next) {
+		if (!job->sheet)
+			continue;
+		add_sheet(ctx, job->sheet);
+		if (job->parse)
+			link_sheets(ctx, job->ctx.jobs);
+	}
+}
+
+
+static void free_jobs(struct sch_job *job)
+{
+	struct sch_job *next;
+
+	for (; job; job = next) {
+		next = job->next;
+		if (job->parse)
+			free_jobs(job->ctx.jobs);
+		if (job->sheet)
+			file_close(&job->file);
+		free(job);
+	}
+}
+
+
+static void parse_sub_sheets(struct sch_ctx *ctx)
+{
+	struct pool *pool = pool_new(jobs);
+	struct sch_job **level = NULL;
+	struct sch_job **next_level = NULL;
+	struct sch_job *job;
+	unsigned n = 0, n_next;
+	unsigned i;
+
+	for (job = ctx->jobs; job; job = job->next) {
+		level = realloc_type_n(level, struct sch_job *, n + 1);
+		level[n++] = job;
+	}
+
+	while (n) {
+		struct hash *busy = hash_new(NULL, sheet_hash, sheet_eq);
+
+		n_next = 0;
+		for (i = 0; i != n; i++) {
+			start_job(ctx, pool, busy, level[i]);
+			if (!level[i]->deferred)
+				continue;
+			next_level = realloc_type_n(next_level,
+			    struct sch_job *, n_next + 1);
+			next_level[n_next++] = level[i];
+		}
+		pool_wait(pool);
+		hash_free(busy);
+
+		for (i = 0; i != n; i++) {
+			if (level[i]->deferred)
+				continue;
+			finish_job(ctx, level[i]);
+			if (!level[i]->parse || !level[i]->ok)
+				continue;
+			for (job = level[i]->ctx.jobs; job; job = job->next) {
+				next_level = realloc_type_n(next_level,
+				    struct sch_job *, n_next + 1);
+				next_level[n_next++] = job;
+			}
+		}
+		swap(level, next_level);
+		n = n_next;
+	}
+	pool_free(pool);
+	free(level);
+	free(next_level);
+
+	link_sheets(ctx, ctx->jobs);
+	free_jobs(ctx->jobs);
+	ctx->jobs = NULL;
+	ctx->next_job = &ctx->jobs;
+}
+
+
+/* ----- Schematics parser (continued) ------------------------------------- */
+
+
+/*
+ * Add the sheet object in ctx->obj and, if we recurse, parse the sub-sheet.
+ * This changes ctx->state.
+ */
+
+void sch_submit_sheet(struct sch_ctx *ctx, const struct file *file)
+{
+	struct sch_obj *sheet_obj;
+	struct sheet *sub;
+
+	sheet_obj = sch_submit_obj(ctx, sch_obj_sheet);
+	sheet_obj->u.sheet.error = 0;
+	if (ctx->parallel) {
+		sheet_obj->u.sheet.sheet = NULL;
+		add_job(ctx, sheet_obj, file);
+	} else if (ctx->recurse) {
+		sub = recurse_sheet(ctx, file);
+		if (!sub)
+			sheet_obj->u.sheet.error = 1;
+		if (sub && sheet_obj->u.sheet.name)
+			sub->title = sheet_obj->u.sheet.name;
+		sheet_obj->u.sheet.sheet = sub;
+	} else {
+		sheet_obj->u.sheet.sheet = NULL;
+	}
+}
+
+
+static bool parse_text(struct sch_ctx *ctx, struct tok *tok)
+{
+	struct sch_obj *obj = &ctx->obj;
+	struct sch_text *text = &obj->u.text;
+	const char *shape, *italic;
+	unsigned shape_len, italic_len;
+	int bold;
+
+	if (tok_is(tok, "Notes")) {
+		text->fn = dwg_text;
+		text->shape = dwg_unspec; /* not used for text */
+	} else if (tok_is(tok, "GLabel")) {
+		text->fn = dwg_glabel;
+	} else if (tok_is(tok, "HLabel")) {
+		text->fn = dwg_hlabel;
+	} else if (tok_is(tok, "Label")) {
+		text->fn = dwg_label;
+		text->shape = dwg_unspec; /* not used for (local) labels */
+	} else {
+		return 0;
+	}
+
+	if (!tok_int(tok, &obj->x) || !tok_int(tok, &obj->y) ||
+	    !tok_int(tok, &text->dir) || !tok_int(tok, &text->dim))
+		return 0;
+	if (text->fn == dwg_glabel || text->fn == dwg_hlabel) {
+		if (!tok_word(tok, &shape, &shape_len))
+			return 0;
+		text->shape = decode_shape(shape, shape_len);
+	}
+
+	/* global labels may lack the style */
+	if (text->fn == dwg_glabel && tok_end(tok)) {
+		text->style = text_normal;
+	} else {
+		if (!tok_word(tok, &italic, &italic_len) ||
+		    !tok_int(tok, &bold))
+			return 0;
+		text->style = decode_style(italic, italic_len, bold);
+	}
+
+	ctx->state = sch_text;
+	return 1;
+}
+
+
+static bool parse_wire(struct sch_ctx *ctx, struct tok *tok, bool entry)
+{
+	struct sch_wire *wire = &ctx->obj.u.wire;
+
+	/*
+	 * Documentation mentions the following additional variants:
+	 *
+	 * - Entry Wire Line equivalent:
+	 *   Wire Wire Bus
+	 *   Entry Wire Bus
+	 *
+	 * - Entry Bus Bus equivalent:
+	 *   Wire Bus Bus
+	 */
+	if (entry) {
+		if (tok_is(tok, "Wire") && tok_is(tok, "Line"))
+			wire->fn = dwg_wire;
+		else if (tok_is(tok, "Bus") && tok_is(tok, "Bus"))
+			wire->fn = dwg_bus;
+		else
+			return 0;
+	} else {
+		if (tok_is(tok, "Wire"))
+			wire->fn = dwg_wire;
+		else if (tok_is(tok, "Bus"))
+			wire->fn = dwg_bus;
+		else if (tok_is(tok, "Notes"))
+			wire->fn = dwg_line;
+		else
+			return 0;
+		if (!tok_is(tok, "Line"))
+			return 0;
+	}
+	ctx->state = sch_wire;
+	return 1;
+}
+
+
+/*
+ * Empty strings in the description are ignored.
+ */
+
+static bool descr_string(struct sch_ctx *ctx, struct tok *tok,
+    const char **res)
+{
+	const char *s;
+	unsigned len;
+
+	if (tok_str(tok, &s, &len) && len)
+		*res = intern_n(s, len);
+	return 1;
+}
+
+
 static bool parse_line(const struct file *file, void *user, const char *line)
 {
 	struct sch_ctx *ctx = user;
 	struct sch_obj *obj = &ctx->obj;
-	int n = 0;	/* use ONLY for %n */
+	struct sheet *sheet = ctx->curr_sheet;
+	struct tok tok;
+	const char *s;
+	unsigned len;
+	int *m;
 	int i;
-	char *s, *italic;
-	int bold;
+
+	tok_init(&tok, line);
 
 	switch (ctx->state) {
 	case sch_basic:
-		if (sscanf(line, "$Comp%n", &n) == 0 && n) {
+		if (tok_is(&tok, "$Comp")) {
 			ctx->state = sch_comp;
+			obj->u.comp.name = NULL;
 			obj->u.comp.fields = NULL;
 			return 1;
 		}
-		if (sscanf(line, "$Sheet%n", &n) == 0 && n) {
+		if (tok_is(&tok, "$Sheet")) {
 			ctx->state = sch_sheet;
 			obj->u.sheet.name = NULL;
 			obj->u.sheet.file = NULL;
@@ -479,225 +1036,165 @@ static bool parse_line(const struct file *file, void *user, const char *line)
 
 		/* Text */
 
-		struct sch_text *text = &obj->u.text;
-
-		if (sscanf(line, "Text Notes %d %d %d %d %ms %d",
-		    &obj->x, &obj->y, &text->dir, &text->dim, &italic, &bold)
-		    == 6) {
-			ctx->state = sch_text;
-			obj->u.text.fn = dwg_text;
-			obj->u.text.shape = dwg_unspec; /* not used for text */
-			obj->u.text.style = decode_style(italic, bold);
-			free(italic);
-			return 1;
-		}
-		n = sscanf(line, "Text GLabel %d %d %d %d %ms %ms %d",
-		    &obj->x, &obj->y, &text->dir, &text->dim, &s,
-		    &italic, &bold);
-		if (n == 5 || n == 7) {
-			ctx->state = sch_text;
-			obj->u.text.fn = dwg_glabel;
-			obj->u.text.shape = decode_shape(s);
-			if (n == 5) {
-				obj->u.text.style = text_normal;
-			} else {
-				obj->u.text.style = decode_style(italic, bold);
-				free(italic);
-			}
-			return 1;
-		}
-		if (sscanf(line, "Text HLabel %d %d %d %d %ms %ms %d",
-		    &obj->x, &obj->y, &text->dir, &text->dim, &s,
-		    &italic, &bold) == 7) {
-			ctx->state = sch_text;
-			obj->u.text.fn = dwg_hlabel;
-			obj->u.text.shape = decode_shape(s);
-			obj->u.text.style = decode_style(italic, bold);
-			free(italic);
-			return 1;
-		}
-		if (sscanf(line, "Text Label %d %d %d %d %ms %d",
-		    &obj->x, &obj->y, &text->dir, &text->dim,
-		    &italic, &bold) == 6) {
-			ctx->state = sch_text;
-			obj->u.text.fn = dwg_label;
-			obj->u.text.shape = dwg_unspec;
-			    /* not used for (local) labels */
-			obj->u.text.style = decode_style(italic, bold);
-			free(italic);
-			return 1;
+		if (tok_is(&tok, "Text")) {
+			if (parse_text(ctx, &tok))
+				return 1;
+			break;
 		}
 
 		/* Connection */
 
-		if (sscanf(line, "Connection ~ %d %d", &obj->x, &obj->y) == 2) {
-			submit_obj(ctx, sch_obj_junction);
+		if (tok_is(&tok, "Connection")) {
+			if (!tok_is(&tok, "~") || !tok_int(&tok, &obj->x) ||
+			    !tok_int(&tok, &obj->y))
+				break;
+			sch_submit_obj(ctx, sch_obj_junction);
 			return 1;
 		}
 
 		/* NoConn */
 
-		if (sscanf(line, "NoConn ~ %d %d", &obj->x, &obj->y) == 2) {
-			submit_obj(ctx, sch_obj_noconn);
-			return 1;
-		}
-
-		/* Wire */
-
-		if (sscanf(line, "Wire Wire Line%n", &n) == 0 && n) {
-			ctx->state = sch_wire;
-			obj->u.wire.fn = dwg_wire;
-			return 1;
-		}
-		if (sscanf(line, "Wire Bus Line%n", &n) == 0 && n) {
-			ctx->state = sch_wire;
-			obj->u.wire.fn = dwg_bus;
-			return 1;
-		}
-		if (sscanf(line, "Wire Notes Line%n", &n) == 0 && n) {
-			ctx->state = sch_wire;
-			obj->u.wire.fn = dwg_line;
+		if (tok_is(&tok, "NoConn")) {
+			if (!tok_is(&tok, "~") || !tok_int(&tok, &obj->x) ||
+			    !tok_int(&tok, &obj->y))
+				break;
+			sch_submit_obj(ctx, sch_obj_noconn);
 			return 1;
 		}
 
-		/* Entry */
+		/* Wire and Entry */
 
-		/*
-		 * Documentation mentions the following additional variants:
-		 *
-		 * - Entry Wire Line equivalent:
-		 *   Wire Wire Bus
-		 *   Entry Wire Bus
-		 *
-		 * - Entry Bus Bus equivalent:
-		 *   Wire Bus Bus
-		 */
-		if (sscanf(line, "Entry Wire Line%n", &n) == 0 && n) {
-			ctx->state = sch_wire;
-			obj->u.wire.fn = dwg_wire;
-			return 1;
+		if (tok_is(&tok, "Wire")) {
+			if (parse_wire(ctx, &tok, 0))
+				return 1;
+			break;
 		}
-		if (sscanf(line, "Entry Bus Bus%n", &n) == 0 && n) {
-			ctx->state = sch_wire;
-			obj->u.wire.fn = dwg_bus;
-			return 1;
+		if (tok_is(&tok, "Entry")) {
+			if (parse_wire(ctx, &tok, 1))
+				return 1;
+			break;
 		}
 
 		/* EndSCHEMATC */
 
-		if (sscanf(line, "$EndSCHEMATC%n", &n) == 0 && n) {
+		if (tok_is(&tok, "$EndSCHEMATC")) {
 			ctx->state = sch_eof;
 			return 1;
 		}
 		break;
 	case sch_descr:
-		if (sscanf(line, "$Descr %ms %d %d",
-		    &ctx->curr_sheet->size,
-		    &ctx->curr_sheet->w, &ctx->curr_sheet->h) == 2)
-			return 1;
-
 		/*
-		 * %[ only accepts non-empty strings, so we fail to parse any
-		 * of the following items if the string is empty. However,
-		 * since we silently ignore all unrecognized lines, this does
-		 * not cause a parse error or warning.
+		 * We silently ignore all unrecognized lines, so a malformed
+		 * item does not cause a parse error or warning.
 		 */
-		if (sscanf(line, "Title \"%m[^\"]\"",
-		    &ctx->curr_sheet->title) == 1)
-			return 1;
-		if (sscanf(line, "Date \"%m[^\"]\"",
-		    &ctx->curr_sheet->date) == 1)
-			return 1;
-		if (sscanf(line, "Rev \"%m[^\"]\"",
-		    &ctx->curr_sheet->rev) == 1)
-			return 1;
-		if (sscanf(line, "Comp \"%m[^\"]\"",
-		    &ctx->curr_sheet->comp) == 1)
+		if (tok_prefix(&tok, "(kicad_sch")) {
+			ctx->state = sch_sexpr;
+			return sch_sexpr_parse_line(ctx, file, line);
+		}
+		if (tok_is(&tok, "$Descr")) {
+			if (!tok_word(&tok, &s, &len))
+				return 1;
+			sheet->size = intern_n(s, len);
+			if (tok_int(&tok, &sheet->w))
+				tok_int(&tok, &sheet->h);
 			return 1;
-		if (sscanf(line, "Comment%d \"%m[^\"]\"", &i, &s) == 2) {
+		}
+		if (tok_is(&tok, "Title"))
+			return descr_string(ctx, &tok, &sheet->title);
+		if (tok_is(&tok, "Date"))
+			return descr_string(ctx, &tok, &sheet->date);
+		if (tok_is(&tok, "Rev"))
+			return descr_string(ctx, &tok, &sheet->rev);
+		if (tok_is(&tok, "Comp"))
+			return descr_string(ctx, &tok, &sheet->comp);
+		if (tok_prefix(&tok, "Comment")) {
+			if (!tok_int(&tok, &i) || !tok_str(&tok, &s, &len) ||
+			    !len)
+				return 1;
 			if (i <= 0)
 				fatal("%s:%u: invalid comment index %d",
 				    file->name, file->lineno, i);
-			add_comment(ctx->curr_sheet, i - 1, s);
+			sch_add_comment(ctx, sheet, i - 1,
+			    intern_n(s, len));
 			return 1;
 		}
 
-		if (sscanf(line, "$EndDescr%n", &n) || !n)
-			return 1;
-		ctx->state = sch_basic;
+		if (tok_is(&tok, "$EndDescr"))
+			ctx->state = sch_basic;
 		return 1;
 	case sch_comp:
-		if (sscanf(line, "$EndComp%n", &n) == 0 && n) {
+		if (tok_is(&tok, "$EndComp")) {
 			ctx->state = sch_basic;
-			submit_obj(ctx, sch_obj_comp);
+			sch_submit_obj(ctx, sch_obj_comp);
 			return 1;
 		}
-		if (sscanf(line, "L %ms", &s) == 1) {
-			obj->u.comp.comp = lib_find(ctx->lib, s);
-			free(s);
+		if (tok_is(&tok, "L")) {
+			if (!tok_word(&tok, &s, &len))
+				break;
+			obj->u.comp.name = intern_n(s, len);
 			return 1;
 		}
-		if (sscanf(line, "U %u %u",
-		    &obj->u.comp.unit, &obj->u.comp.convert) == 2)
-			return 1;
-		if (sscanf(line, "P %d %d", &obj->x, &obj->y) == 2)
-			return 1;
-		if (parse_field(ctx, line))
-			return 1;
-		if (sscanf(line, "AR %n", &n) == 0 && n)
+		if (tok_is(&tok, "U")) {
+			if (tok_unsigned(&tok, &obj->u.comp.unit) &&
+			    tok_unsigned(&tok, &obj->u.comp.convert))
+				return 1;
+			break;
+		}
+		if (tok_is(&tok, "P")) {
+			if (tok_int(&tok, &obj->x) && tok_int(&tok, &obj->y))
+				return 1;
+			break;
+		}
+		if (tok_is(&tok, "F")) {
+			if (parse_field(ctx, &tok))
+				return 1;
+			break;
+		}
+		if (tok_is(&tok, "AR"))
 			return 1; /* @@@ what is "AR" ? */
-		n = sscanf(line, " %d %d %d %d",
-		    obj->u.comp.m + 1, obj->u.comp.m + 2,
-		    obj->u.comp.m + 4, obj->u.comp.m + 5);
-		if (n == 3)
-			return 1;
-		if (n == 4) {
-			obj->u.comp.m[0] = obj->x;
-			obj->u.comp.m[3] = obj->y;
+
+		/* "1 x y" (ignored), then the transformation matrix */
+		m = obj->u.comp.m;
+		if (!tok_int(&tok, m + 1) || !tok_int(&tok, m + 2) ||
+		    !tok_int(&tok, m + 4))
+			break;
+		if (!tok_int(&tok, m + 5))
 			return 1;
-		}
-		break;
+		m[0] = obj->x;
+		m[3] = obj->y;
+		return 1;
 	case sch_sheet:
-		if (sscanf(line, "$EndSheet%n", &n) == 0 && n) {
-			struct sch_obj *sheet_obj;
-
-			sheet_obj = submit_obj(ctx, sch_obj_sheet);
-			sheet_obj->u.sheet.error = 0;
-			if (ctx->recurse) {
-				struct sheet *sheet;
-
-				sheet = recurse_sheet(ctx, file);
-				if (!sheet)
-					sheet_obj->u.sheet.error = 1;
-				if (sheet && sheet_obj->u.sheet.name) {
-					free((char *) sheet->title);
-					sheet->title =
-					    stralloc(sheet_obj->u.sheet.name);
-				}
-				sheet_obj->u.sheet.sheet = sheet;
-			} else {
-				sheet_obj->u.sheet.sheet = NULL;
-			}
+		if (tok_is(&tok, "$EndSheet")) {
+			sch_submit_sheet(ctx, file);
 			ctx->state = sch_basic;
 			return 1;
 		}
-		if (sscanf(line, "S %d %d %u %u",
-		    &obj->x, &obj->y, &obj->u.sheet.w, &obj->u.sheet.h) == 4)
-			return 1;
-		if (sscanf(line, "U %*x%n", &n) == 0 && n)
-			return 1;
-		if (parse_hsheet_field(ctx, line))
-			return 1;
+		if (tok_is(&tok, "S")) {
+			if (tok_int(&tok, &obj->x) && tok_int(&tok, &obj->y) &&
+			    tok_unsigned(&tok, &obj->u.sheet.w) &&
+			    tok_unsigned(&tok, &obj->u.sheet.h))
+				return 1;
+			break;
+		}
+		if (tok_is(&tok, "U")) {
+			if (tok_word(&tok, &s, &len))
+				return 1;
+			break;
+		}
+		if (tok_prefix(&tok, "F")) {
+			if (parse_hsheet_field(ctx, &tok))
+				return 1;
+			break;
+		}
 		break;
 	case sch_text:
 		ctx->state = sch_basic;
 		{
 			const char *from;
-			char *to;
+			char *tmp, *to;
 
-			s = alloc_size(strlen(line) + 1);
+			tmp = to = alloc_size(strlen(line) + 1);
 			from = line;
-			to = s;
 			while (*from) {
 				if (from[0] != '\\' || from[1] != 'n') {
 					*to++ = *from++;
@@ -707,18 +1204,22 @@ static bool parse_line(const struct file *file, void *user, const char *line)
 				from += 2;
 			}
 			*to = 0;
-			obj->u.text.s = s;
-			submit_obj(ctx, obj->u.text.fn == dwg_glabel ?
+			obj->u.text.s = intern(tmp);
+			free(tmp);
+			sch_submit_obj(ctx, obj->u.text.fn == dwg_glabel ?
 			    sch_obj_glabel : sch_obj_text);
 		}
 		return 1;
 	case sch_wire:
-		if (sscanf(line, "%d %d %d %d", &obj->x, &obj->y,
-		    &obj->u.wire.ex, &obj->u.wire.ey) != 4)
+		if (!tok_int(&tok, &obj->x) || !tok_int(&tok, &obj->y) ||
+		    !tok_int(&tok, &obj->u.wire.ex) ||
+		    !tok_int(&tok, &obj->u.wire.ey))
 			break;
-		submit_obj(ctx, sch_obj_wire);
+		sch_submit_obj(ctx, sch_obj_wire);
 		ctx->state = sch_basic;
 		return 1;
+	case sch_sexpr:
+		return sch_sexpr_parse_line(ctx, file, line);
 	case sch_eof:
 		return 1;
 	default:
@@ -728,101 +1229,61 @@ static bool parse_line(const struct file *file, void *user, const char *line)
 }
 
 
-bool sch_parse(struct sch_ctx *ctx, struct file *file, const struct lib *lib,
-    const struct sch_ctx *prev)
+bool sch_parse(struct sch_ctx *ctx, struct file *file, const struct lib *lib)
 {
-	ctx->curr_sheet->file = stralloc(sanitize_file_name(file->name));
-	ctx->curr_sheet->mtime = file->mtime;
-	ctx->curr_sheet->path = stralloc("/");
-	ctx->lib = lib;
-	ctx->prev = prev;
-	return file_read(file, parse_line, ctx);
+	struct sheet *sheet = ctx->curr_sheet;
+
+	sheet->file = intern(sanitize_file_name(file->name));
+	sheet->mtime = file->mtime;
+	sheet->dev = file->dev;
+	sheet->ino = file->ino;
+	sheet->path = intern("/");
+	sheet->oid = file_oid(file);
+	sheet->lib = ctx->lib = lib;
+	if (reuse_sheet(ctx, sheet))
+		return 1;
+	ctx->parallel = ctx->recurse && jobs > 1;
+	if (!read_sheet(ctx, file))
+		return 0;
+	if (ctx->parallel)
+		parse_sub_sheets(ctx);
+	index_syms(ctx, sheet);
+	remember_sheet(ctx, sheet, 1);
+	return 1;
 }
 
 
 void sch_init(struct sch_ctx *ctx, bool recurse)
 {
 	ctx->state = sch_descr;
+	ctx->arena = arena_new();
 	ctx->recurse = recurse;
+	ctx->parallel = 0;
 	ctx->curr_sheet = NULL;
 	ctx->sheets = NULL;
 	ctx->next_sheet = &ctx->sheets;
+	ctx->jobs = NULL;
+	ctx->next_job = &ctx->jobs;
+	ctx->lib = NULL;
+	ctx->sexpr = NULL;
+	ctx->parsed = hash_new(ctx->arena, sheet_hash, sheet_eq);
 	new_sheet(ctx);
 }
 
 
-static void free_comp_fields(struct comp_field *fields)
-{
-	struct comp_field *next;
-
-	while (fields) {
-		next = fields->next;
-		free((char *) fields->txt.s);
-		free(fields);
-		fields = next;
-	}
-}
-
-
-static void free_sheet_fields(struct sheet_field *fields)
-{
-	struct sheet_field *next;
-
-	while (fields) {
-		next = fields->next;
-		free((char *) fields->s);
-		free(fields);
-		fields = next;
-	}
-}
-
-
-static void free_sheet(struct sheet *sch)
-{
-	struct sch_obj *obj, *next;
-
-	if (!sch)
-		return;
-	free((char *) sch->title);
-	free((char *) sch->file);
-	free((char *) sch->path);
-	free((char *) sch->size);
-	free(sch->oid);
-	for (obj = sch->objs; obj; obj = next) {
-		next = obj->next;
-		switch (obj->type) {
-		case sch_obj_glabel:
-		case sch_obj_text:
-			free((char *) obj->u.text.s);
-			break;
-		case sch_obj_comp:
-			free_comp_fields(obj->u.comp.fields);
-			break;
-		case sch_obj_sheet:
-			free((char *) obj->u.sheet.name);
-			free((char *) obj->u.sheet.file);
-			/*
-			 * Caller frees all sheets, including this sub-sheet
-			 * (obj->u.sheet.sheet), so we don't do this here.
-			 */
-			free_sheet_fields(obj->u.sheet.fields);
-			break;
-		default:
-			break;
-		}
-		free(obj);
-	}
-	free(sch);
-}
-
+/*
+ * Everything but the OIDs lives in the arena. Sheets borrowed from other
+ * contexts hold a reference on the arena of their objects.
+ */
 
 void sch_free(struct sch_ctx *ctx)
 {
-	struct sheet *next;
+	struct sheet *sheet;
 
-	while (ctx->sheets) {
-		next = ctx->sheets->next;
-		free_sheet(ctx->sheets);
-		ctx->sheets = next;
+	for (sheet = ctx->sheets; sheet; sheet = sheet->next) {
+		free(sheet->oid);
+		arena_unref(sheet->objs_arena);
 	}
+	arena_unref(ctx->arena);
+	ctx->sheets = NULL;
 }
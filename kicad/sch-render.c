@@ -12,11 +12,13 @@
 
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/hash.h"
 #include "gfx/misc.h"
 #include "gfx/style.h"
 #include "gfx/gfx.h"
@@ -25,15 +27,72 @@
 #include "kicad/sch.h"
 
 
+/* ----- Components -------------------------------------------------------- */
+
+
+/*
+ * Components are looked up in the library only when we need them. Since the
+ * same objects can be shared by sheets using different libraries, each sheet
+ * keeps the components it has found, by symbol.
+ */
+
+static const struct comp not_found;
+
+
+const struct comp *sch_find_comp(const struct sheet *sheet,
+    const struct sch_comp *comp)
+{
+	const struct comp **res;
+
+	if (!comp->name)
+		return NULL;
+	res = sheet->comps + comp->sym;
+	if (!*res) {
+		if (sheet->embedded)
+			*res = hash_lookup(sheet->embedded->index, comp->name);
+		if (!*res)
+			*res = lib_find(sheet->lib, comp->name);
+		if (!*res)
+			*res = &not_found;
+	}
+	return *res == &not_found ? NULL : *res;
+}
+
+
+/*
+ * Return the reference with the unit suffix (e.g., U1A) if the component has
+ * more than one unit.
+ */
+
+char *sch_comp_ref(const struct sheet *sheet, const struct sch_comp *comp,
+    const char *ref)
+{
+	const struct comp *c = sch_find_comp(sheet, comp);
+	char *s;
+
+	if (!c || c->units < 2)
+		return stralloc(ref);
+	if (comp->unit <= 26)
+		alloc_printf(&s, "%s%c", ref, 'A' + comp->unit - 1);
+	else
+		alloc_printf(&s, "%s%c%c", ref,
+		    'A' + (comp->unit - 1) / 26 - 1,
+		    'A' + (comp->unit - 1) % 26);
+	return s;
+}
+
+
 /* ----- Rendering --------------------------------------------------------- */
 
 
-static void dump_field(const struct comp_field *field, struct gfx *gfx,
-    const int m[6])
+static void dump_field(const struct comp_field *field, const char *s,
+    struct gfx *gfx, const int m[6])
 {
 	struct text txt = field->txt;
 	int dx, dy;
 
+	txt.s = s;
+
 	dx = txt.x - m[0];
 	dy = txt.y - m[3];
 	txt.x = mx(dx, dy, m);
@@ -117,11 +176,14 @@ static void do_hsheet_text(const struct sch_obj *obj,
 }
 
 
-static void render_comp(const struct sch_comp *comp, struct gfx *gfx)
+static void render_comp(const struct sheet *sheet,
+    const struct sch_comp *comp, struct gfx *gfx)
 {
 	const struct comp_field *field;
+	char *ref;
 
-	lib_render(comp->comp, gfx, comp->unit, comp->convert, comp->m);
+	lib_render(sch_find_comp(sheet, comp), gfx, comp->unit, comp->convert,
+	    comp->m);
 	for (field = comp->fields; field; field = field->next) {
 		if (!field->visible) {
 			if (field->n == 0)
@@ -131,7 +193,13 @@ static void render_comp(const struct sch_comp *comp, struct gfx *gfx)
 			else
 				continue;
 		}
-		dump_field(field, gfx, comp->m);
+		if (field->n == 0) {
+			ref = sch_comp_ref(sheet, comp, field->txt.s);
+			dump_field(field, ref, gfx, comp->m);
+			free(ref);
+		} else {
+			dump_field(field, field->txt.s, gfx, comp->m);
+		}
 		gfx_set_extra(gfx, 0);
 	}
 }
@@ -187,7 +255,7 @@ void sch_render(const struct sheet *sheet, struct gfx *gfx)
 			}
 			break;
 		case sch_obj_comp:
-			render_comp(&obj->u.comp, gfx);
+			render_comp(sheet, &obj->u.comp, gfx);
 			break;
 		case sch_obj_sheet:
 			render_sheet(obj, &obj->u.sheet, gfx);
@@ -0,0 +1,682 @@
+/*
+ * kicad/sch-sexpr.c - Parse KiCad s-expression schematics (.kicad_sch)
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc/util.h"
+#include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/intern.h"
+#include "gfx/text.h"
+#include "file/file.h"
+#include "kicad/kicad.h"
+#include "kicad/dwg.h"
+#include "kicad/sexpr.h"
+#include "kicad/sexpr-item.h"
+#include "kicad/lib.h"
+#include "kicad/sch.h"
+
+
+/*
+ * Like .kicad_sym files, schematics are streamed, and each item at the top
+ * level is built as a tree of its own. The symbols in "lib_symbols" are one
+ * level deeper and are items of their own as well.
+ */
+
+struct sch_sexpr {
+	struct sexpr_ctx *parser;
+	struct sexpr_item *item;
+	const struct file *file;	/* for finding sub-sheets */
+	bool in_item;
+	bool in_lib_symbols;
+	bool done;
+	struct lib *embedded;		/* NULL if the sheet has no symbols */
+};
+
+
+/* ----- Helpers ----------------------------------------------------------- */
+
+
+static const char *get_str(struct sch_ctx *ctx, const struct expr *e,
+    const char *kw)
+{
+	const char *s = sexpr_arg(sexpr_find(e, kw), 0);
+
+	return s && *s ? intern(s) : NULL;
+}
+
+
+/* ----- Paper and title block --------------------------------------------- */
+
+
+static void paper(struct sch_ctx *ctx, const struct expr *e)
+{
+	static const struct {
+		const char *name;
+		double w, h;	/* mm, landscape */
+	} sizes[] = {
+		{ "A4",		297,	210 },
+		{ "A3",		420,	297 },
+		{ "A2",		594,	420 },
+		{ "A1",		841,	594 },
+		{ "A0",		1189,	841 },
+		{ "A",		279.4,	215.9 },
+		{ "B",		431.8,	279.4 },
+		{ "C",		558.8,	431.8 },
+		{ "D",		863.6,	558.8 },
+		{ "E",		1117.6,	863.6 },
+		{ "USLetter",	279.4,	215.9 },
+		{ "USLegal",	355.6,	215.9 },
+		{ "USLedger",	431.8,	279.4 },
+	};
+	struct sheet *sheet = ctx->curr_sheet;
+	const char *name = sexpr_arg(e, 0);
+	double w, h;
+	unsigned i;
+
+	if (!name)
+		return;
+	sheet->size = intern(name);
+	if (!strcmp(name, "User")) {
+		if (sexpr_num(e, 1, &w) && sexpr_num(e, 2, &h)) {
+			sheet->w = mm_to_mil(w);
+			sheet->h = mm_to_mil(h);
+		}
+		return;
+	}
+	for (i = 0; i != ARRAY_ELEMENTS(sizes); i++)
+		if (!strcmp(name, sizes[i].name))
+			break;
+	if (i == ARRAY_ELEMENTS(sizes)) {
+		warning("unknown paper size \"%s\"", name);
+		return;
+	}
+	sheet->w = mm_to_mil(sizes[i].w);
+	sheet->h = mm_to_mil(sizes[i].h);
+	if (sexpr_flag(e, "portrait"))
+		swap(sheet->w, sheet->h);
+}
+
+
+static void title_block(struct sch_ctx *ctx, const struct expr *e)
+{
+	struct sheet *sheet = ctx->curr_sheet;
+	const struct expr *sub;
+	const char *s;
+	double n;
+
+	sheet->title = get_str(ctx, e, "title");
+	sheet->date = get_str(ctx, e, "date");
+	sheet->rev = get_str(ctx, e, "rev");
+	sheet->comp = get_str(ctx, e, "company");
+	for (sub = e->next; sub; sub = sub->next) {
+		if (!sub->e || !sub->e->s || strcmp(sub->e->s, "comment"))
+			continue;
+		s = sexpr_arg(sub->e, 1);
+		if (!sexpr_num(sub->e, 0, &n) || n < 1 || !s || !*s)
+			continue;
+		sch_add_comment(ctx, sheet, n - 1,
+		    intern(s));
+	}
+}
+
+
+/* ----- Connections ------------------------------------------------------- */
+
+
+static bool point(struct sch_ctx *ctx, const struct expr *e,
+    enum sch_obj_type type)
+{
+	if (!sexpr_xy(e, "at", &ctx->obj.x, &ctx->obj.y))
+		return 0;
+	sch_submit_obj(ctx, type);
+	return 1;
+}
+
+
+static bool bus_entry(struct sch_ctx *ctx, const struct expr *e)
+{
+	struct sch_obj *obj = &ctx->obj;
+	int dx, dy;
+
+	if (!sexpr_xy(e, "at", &obj->x, &obj->y) ||
+	    !sexpr_xy(e, "size", &dx, &dy))
+		return 0;
+	obj->u.wire.fn = dwg_wire;
+	obj->u.wire.ex = obj->x + dx;
+	obj->u.wire.ey = obj->y + dy;
+	sch_submit_obj(ctx, sch_obj_wire);
+	return 1;
+}
+
+
+/*
+ * Wires and buses have two points. Graphical lines can have more, and are
+ * split into segments.
+ */
+
+static bool wire(struct sch_ctx *ctx, const struct expr *e,
+    void (*fn)(struct gfx *gfx, int sx, int sy, int ex, int ey))
+{
+	struct sch_obj *obj = &ctx->obj;
+	const struct expr *pts = sexpr_find(e, "pts");
+	const struct expr *p;
+	bool first = 1;
+	double x, y;
+
+	if (!pts)
+		return 0;
+	obj->u.wire.fn = fn;
+	for (p = pts->next; p; p = p->next) {
+		if (!p->e || !p->e->s || strcmp(p->e->s, "xy"))
+			continue;
+		if (!sexpr_num(p->e, 0, &x) || !sexpr_num(p->e, 1, &y))
+			return 0;
+		if (!first) {
+			obj->x = obj->u.wire.ex;
+			obj->y = obj->u.wire.ey;
+		}
+		obj->u.wire.ex = mm_to_mil(x);
+		obj->u.wire.ey = mm_to_mil(y);
+		if (!first)
+			sch_submit_obj(ctx, sch_obj_wire);
+		first = 0;
+	}
+	return 1;
+}
+
+
+/* ----- Text and labels --------------------------------------------------- */
+
+
+static enum dwg_shape decode_shape(const char *s, bool sheet_pin)
+{
+	if (!s)
+		return dwg_unspec;
+	if (!strcmp(s, "input"))
+		return sheet_pin ? dwg_out : dwg_in;
+	if (!strcmp(s, "output"))
+		return sheet_pin ? dwg_in : dwg_out;
+	if (!strcmp(s, "bidirectional"))
+		return dwg_bidir;
+	if (!strcmp(s, "tri_state"))
+		return sheet_pin ? dwg_bidir : dwg_tri;
+	if (!strcmp(s, "passive"))
+		return dwg_unspec;
+	warning("unknown shape \"%s\"", s);
+	return dwg_unspec;
+}
+
+
+/*
+ * The legacy direction of text and local labels is the direction in which the
+ * text extends from its anchor. Global and hierarchical labels use the
+ * opposite horizontal directions.
+ */
+
+static bool text(struct sch_ctx *ctx, const struct expr *e,
+    void (*fn)(struct gfx *gfx, int x, int y, const char *s, int dir,
+    int dim, enum dwg_shape shape, enum text_style style,
+    struct dwg_bbox *bbox))
+{
+	struct sch_obj *obj = &ctx->obj;
+	struct sch_text *text = &obj->u.text;
+	const char *s = sexpr_arg(e, 0);
+	char hor, vert;
+	bool hidden;
+
+	if (!s || !sexpr_xy(e, "at", &obj->x, &obj->y))
+		return 0;
+	text->fn = fn;
+	text->s = intern(s);
+	text->dir = sexpr_angle(e) / 90;
+	if ((fn == dwg_glabel || fn == dwg_hlabel) && !(text->dir & 1))
+		text->dir ^= 2;
+	sexpr_effects(e, &text->dim, &text->style, &hor, &vert, &hidden);
+	text->shape = fn == dwg_glabel || fn == dwg_hlabel ?
+	    decode_shape(sexpr_arg(sexpr_find(e, "shape"), 0), 0) : dwg_unspec;
+	sch_submit_obj(ctx, fn == dwg_glabel ? sch_obj_glabel : sch_obj_text);
+	return 1;
+}
+
+
+/* ----- Symbols ----------------------------------------------------------- */
+
+
+/*
+ * Property positions are where the text appears, while we store them like
+ * the legacy format does, i.e., before the transformation of the component.
+ * The transformation is orthogonal, so its inverse is its transpose.
+ */
+
+static void property(struct sch_ctx *ctx, const struct expr *e,
+    unsigned *next_id)
+{
+	static const char *names[] = {
+		"Reference", "Value", "Footprint", "Datasheet"
+	};
+	struct sch_comp *comp = &ctx->obj.u.comp;
+	const int *m = comp->m;
+	const char *name = sexpr_arg(e, 0);
+	const char *s = sexpr_arg(e, 1);
+	struct comp_field *field;
+	struct text *txt;
+	char hor, vert;
+	bool hidden;
+	double id;
+	int x, y;
+	unsigned i;
+
+	if (!name || !s || !sexpr_xy(e, "at", &x, &y))
+		return;
+	if (sexpr_num(sexpr_find(e, "id"), 0, &id)) {
+		i = id;
+	} else {
+		for (i = 0; i != ARRAY_ELEMENTS(names); i++)
+			if (!strcmp(name, names[i]))
+				break;
+		if (i == ARRAY_ELEMENTS(names))
+			i = (*next_id)++;
+	}
+
+	/* ignore fields with empty string as content */
+	if (!*s)
+		return;
+
+	field = arena_alloc_type(ctx->arena, struct comp_field);
+	field->n = i;
+	txt = &field->txt;
+	txt->s = intern(s);
+	x -= m[0];
+	y -= m[3];
+	txt->x = m[0] + m[1] * x + m[4] * y;
+	txt->y = m[3] + m[2] * x + m[5] * y;
+	txt->rot = sexpr_angle(e) % 180;
+	sexpr_effects(e, &txt->size, &txt->style, &hor, &vert, &hidden);
+	decode_alignment(txt, hor, vert);
+	field->visible = !hidden;
+
+	field->next = comp->fields;
+	comp->fields = field;
+}
+
+
+/*
+ * Symbols are rotated counter-clockwise, after being mirrored. "mirror x"
+ * flips the symbol vertically, "mirror y" horizontally.
+ */
+
+static bool symbol(struct sch_ctx *ctx, const struct expr *e)
+{
+	struct sch_obj *obj = &ctx->obj;
+	struct sch_comp *comp = &obj->u.comp;
+	const struct expr *mirror = sexpr_find(e, "mirror");
+	const char *name = sexpr_arg(sexpr_find(e, "lib_name"), 0);
+	const struct expr *sub;
+	unsigned next_id = 4;
+	int fx, fy, c, s;
+	double n;
+
+	if (!name)
+		name = sexpr_arg(sexpr_find(e, "lib_id"), 0);
+	if (!name || !sexpr_xy(e, "at", &obj->x, &obj->y))
+		return 0;
+	comp->name = intern(name);
+	comp->unit = sexpr_num(sexpr_find(e, "unit"), 0, &n) ? n : 1;
+	comp->convert = sexpr_num(sexpr_find(e, "convert"), 0, &n) ||
+	    sexpr_num(sexpr_find(e, "body_style"), 0, &n) ? n : 1;
+
+	fx = sexpr_flag(mirror, "y") ? -1 : 1;
+	fy = sexpr_flag(mirror, "x") ? -1 : 1;
+	switch (sexpr_angle(e)) {
+	case 0:
+		c = 1;
+		s = 0;
+		break;
+	case 90:
+		c = 0;
+		s = 1;
+		break;
+	case 180:
+		c = -1;
+		s = 0;
+		break;
+	case 270:
+		c = 0;
+		s = -1;
+		break;
+	default:
+		return 0;
+	}
+	comp->m[0] = obj->x;
+	comp->m[1] = c * fx;
+	comp->m[2] = -s * fy;
+	comp->m[3] = obj->y;
+	comp->m[4] = -s * fx;
+	comp->m[5] = -c * fy;
+
+	comp->fields = NULL;
+	for (sub = e->next; sub; sub = sub->next)
+		if (sub->e && sub->e->s && !strcmp(sub->e->s, "property"))
+			property(ctx, sub->e, &next_id);
+
+	sch_submit_obj(ctx, sch_obj_comp);
+	return 1;
+}
+
+
+static void lib_symbol(struct sch_ctx *ctx, const struct expr *e)
+{
+	struct sch_sexpr *sx = ctx->sexpr;
+
+	if (!sx->embedded) {
+		sx->embedded = arena_alloc_type(ctx->arena, struct lib);
+		lib_init(sx->embedded);
+		arena_attach(ctx->arena, sx->embedded->arena);
+		arena_unref(sx->embedded->arena);
+		ctx->curr_sheet->embedded = sx->embedded;
+	}
+	lib_sexpr_symbol(sx->embedded, e);
+}
+
+
+/* ----- Sub-sheets -------------------------------------------------------- */
+
+
+static void sheet_pin(struct sch_ctx *ctx, const struct expr *e)
+{
+	struct sch_sheet *sheet = &ctx->obj.u.sheet;
+	const char *s = sexpr_arg(e, 0);
+	struct sheet_field *field;
+	enum text_style style;
+	char hor, vert;
+	bool hidden;
+	int x, y, dim;
+
+	if (!s || !sexpr_xy(e, "at", &x, &y))
+		return;
+	field = arena_alloc_type(ctx->arena, struct sheet_field);
+	field->s = intern(s);
+	field->x = x;
+	field->y = y;
+	sexpr_effects(e, &dim, &style, &hor, &vert, &hidden);
+	field->dim = dim;
+	field->shape = decode_shape(sexpr_arg(e, 1), 1);
+	switch (sexpr_angle(e)) {
+	case 0:
+		field->side = 0;	/* right */
+		break;
+	case 90:
+		field->side = 3;	/* top */
+		sheet->rotated = 1;
+		break;
+	case 180:
+		field->side = 2;	/* left */
+		break;
+	case 270:
+		field->side = 1;	/* bottom */
+		sheet->rotated = 1;
+		break;
+	default:
+		return;
+	}
+
+	field->next = sheet->fields;
+	sheet->fields = field;
+}
+
+
+/*
+ * The property names changed from "Sheet name" and "Sheet file" to
+ * "Sheetname" and "Sheetfile" in KiCad 7.
+ */
+
+static bool sheet(struct sch_ctx *ctx, const struct expr *e)
+{
+	struct sch_obj *obj = &ctx->obj;
+	struct sch_sheet *sheet = &obj->u.sheet;
+	struct sch_sexpr *sx = ctx->sexpr;
+	const struct expr *sub;
+	const char *name, *s;
+	enum text_style style;
+	char hor, vert;
+	bool hidden;
+	int w, h, dim;
+
+	if (!sexpr_xy(e, "at", &obj->x, &obj->y) ||
+	    !sexpr_xy(e, "size", &w, &h))
+		return 0;
+	sheet->w = w;
+	sheet->h = h;
+	sheet->name = sheet->file = NULL;
+	sheet->name_dim = sheet->file_dim = 50;
+	sheet->rotated = 0;
+	sheet->fields = NULL;
+	sheet->sheet = NULL;
+
+	for (sub = e->next; sub; sub = sub->next) {
+		if (!sub->e || !sub->e->s)
+			continue;
+		if (!strcmp(sub->e->s, "pin")) {
+			sheet_pin(ctx, sub->e);
+			continue;
+		}
+		if (strcmp(sub->e->s, "property"))
+			continue;
+		name = sexpr_arg(sub->e, 0);
+		s = sexpr_arg(sub->e, 1);
+		if (!name || !s)
+			continue;
+		sexpr_effects(sub->e, &dim, &style, &hor, &vert, &hidden);
+		if (!strcmp(name, "Sheet name") ||
+		    !strcmp(name, "Sheetname")) {
+			sheet->name = intern(s);
+			sheet->name_dim = dim;
+		}
+		if (!strcmp(name, "Sheet file") ||
+		    !strcmp(name, "Sheetfile")) {
+			sheet->file = intern(s);
+			sheet->file_dim = dim;
+		}
+	}
+	if (!sheet->name || !sheet->file)
+		return 0;
+
+	/*
+	 * Parsing the sub-sheet uses our context, including the streaming
+	 * state, so we save and restore it.
+	 */
+	ctx->sexpr = NULL;
+	sch_submit_sheet(ctx, sx->file);
+	ctx->sexpr = sx;
+	ctx->state = sch_sexpr;
+	return 1;
+}
+
+
+/* ----- Items ------------------------------------------------------------- */
+
+
+static void item(struct sch_ctx *ctx, const struct expr *e)
+{
+	static const char *ignore[] = {
+		"version", "generator", "generator_version", "uuid",
+		"sheet_instances", "symbol_instances", "bus_alias", "image",
+		"text_box", "netclass_flag", "directive_label", "rule_area",
+		"embedded_fonts",
+	};
+	const char *kw = e ? e->s : NULL;
+	bool ok;
+	unsigned i;
+
+	if (!kw)
+		return;
+	if (!strcmp(kw, "paper")) {
+		paper(ctx, e);
+		return;
+	}
+	if (!strcmp(kw, "title_block")) {
+		title_block(ctx, e);
+		return;
+	}
+
+	if (!strcmp(kw, "junction"))
+		ok = point(ctx, e, sch_obj_junction);
+	else if (!strcmp(kw, "no_connect"))
+		ok = point(ctx, e, sch_obj_noconn);
+	else if (!strcmp(kw, "bus_entry"))
+		ok = bus_entry(ctx, e);
+	else if (!strcmp(kw, "wire"))
+		ok = wire(ctx, e, dwg_wire);
+	else if (!strcmp(kw, "bus"))
+		ok = wire(ctx, e, dwg_bus);
+	else if (!strcmp(kw, "polyline"))
+		ok = wire(ctx, e, dwg_line);
+	else if (!strcmp(kw, "text"))
+		ok = text(ctx, e, dwg_text);
+	else if (!strcmp(kw, "label"))
+		ok = text(ctx, e, dwg_label);
+	else if (!strcmp(kw, "global_label"))
+		ok = text(ctx, e, dwg_glabel);
+	else if (!strcmp(kw, "hierarchical_label"))
+		ok = text(ctx, e, dwg_hlabel);
+	else if (!strcmp(kw, "symbol"))
+		ok = symbol(ctx, e);
+	else if (!strcmp(kw, "sheet"))
+		ok = sheet(ctx, e);
+	else {
+		for (i = 0; i != ARRAY_ELEMENTS(ignore); i++)
+			if (!strcmp(kw, ignore[i]))
+				return;
+		warning("%s: unknown item \"%s\"", ctx->sexpr->file->name, kw);
+		return;
+	}
+	if (!ok)
+		warning("%s: cannot parse %s", ctx->sexpr->file->name, kw);
+}
+
+
+/* ----- Streaming --------------------------------------------------------- */
+
+
+static bool sch_enter(void *user, unsigned depth)
+{
+	struct sch_ctx *ctx = user;
+	struct sch_sexpr *sx = ctx->sexpr;
+
+	if (sx->in_item) {
+		sexpr_item_enter(sx->item);
+	} else if (depth == (sx->in_lib_symbols ? 3 : 2)) {
+		sx->in_item = 1;
+		sexpr_item_begin(sx->item);
+	}
+	return 1;
+}
+
+
+static bool sch_atom(void *user, const char *s, unsigned depth)
+{
+	struct sch_ctx *ctx = user;
+	struct sch_sexpr *sx = ctx->sexpr;
+
+	if (!sx->in_item)
+		return 1;
+	if (depth == 2 && !sexpr_item_expr(sx->item) &&
+	    !strcmp(s, "lib_symbols")) {
+		sx->in_item = 0;
+		sx->in_lib_symbols = 1;
+		return 1;
+	}
+	sexpr_item_atom(sx->item, s);
+	return 1;
+}
+
+
+static bool sch_leave(void *user, unsigned depth)
+{
+	struct sch_ctx *ctx = user;
+	struct sch_sexpr *sx = ctx->sexpr;
+	const struct expr *e;
+
+	if (depth == 1) {
+		sx->done = 1;
+		return 1;
+	}
+	if (!sx->in_item) {
+		if (depth == 2)
+			sx->in_lib_symbols = 0;
+		return 1;
+	}
+	if (!sexpr_item_leave(sx->item))
+		return 1;
+	sx->in_item = 0;
+	e = sexpr_item_expr(sx->item);
+	if (sx->in_lib_symbols)
+		lib_symbol(ctx, e);
+	else
+		item(ctx, e);
+	return 1;
+}
+
+
+void sch_sexpr_free(struct sch_ctx *ctx)
+{
+	struct sch_sexpr *sx = ctx->sexpr;
+
+	if (!sx)
+		return;
+	sexpr_free(sx->parser);
+	sexpr_item_free(sx->item);
+	free(sx);
+	ctx->sexpr = NULL;
+}
+
+
+/*
+ * Lines are passed with their newline, so that a word at the end of a line
+ * doesn't run into the next one.
+ */
+
+bool sch_sexpr_parse_line(struct sch_ctx *ctx, const struct file *file,
+    const char *line)
+{
+	static const struct sexpr_ops ops = {
+		.enter	= sch_enter,
+		.atom	= sch_atom,
+		.leave	= sch_leave,
+	};
+	struct sch_sexpr *sx = ctx->sexpr;
+
+	if (!sx) {
+		sx = alloc_type(struct sch_sexpr);
+		sx->parser = sexpr_new_stream(&ops, ctx);
+		sx->item = sexpr_item_new();
+		sx->file = file;
+		sx->in_item = 0;
+		sx->in_lib_symbols = 0;
+		sx->done = 0;
+		sx->embedded = NULL;
+		ctx->sexpr = sx;
+	}
+	if (!sexpr_parse(sx->parser, line) || !sexpr_parse(sx->parser, "\n"))
+		return 0;
+	if (!sx->done)
+		return 1;
+	if (!sexpr_finish(sx->parser, NULL))
+		return 0;
+	sch_sexpr_free(ctx);
+	ctx->state = sch_eof;
+	return 1;
+}
@@ -15,10 +15,12 @@
 #define KICAD_SCH_H
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include "kicad/dwg.h"
 #include "gfx/text.h"
 #include "gfx/gfx.h"
+#include "misc/arena.h"
 #include "file/file.h"
 #include "kicad/lib.h"
 
@@ -30,10 +32,13 @@ enum sch_state {
 	sch_sheet,	/* sub-sheet */
 	sch_text,	/* text or label */
 	sch_wire,	/* wire */
+	sch_sexpr,	/* in a .kicad_sch file */
 	sch_eof,	/* skipping anything after $EndSCHEMATC */
 };
 
 struct sheet;
+struct sch_job;
+struct sch_sexpr;
 
 struct sch_obj {
 	enum sch_obj_type {
@@ -67,7 +72,8 @@ struct sch_obj {
 			struct dwg_bbox bbox; /* set when rendering; glabel */
 		} text;
 		struct sch_comp {
-			const struct comp *comp; /* current component */
+			const char *name; /* name used in the schematics */
+			unsigned sym;	/* index into sheet->syms */
 			unsigned unit;	/* unit of current component */
 			unsigned convert;/* "De Morgan"  selection */
 			struct comp_field {
@@ -90,7 +96,7 @@ struct sch_obj {
 				/* pointer to sub-sheet; NULL if absent */
 
 			struct sheet_field {
-				char *s;
+				const char *s;
 				int x, y;
 				unsigned dim;
 				enum dwg_shape shape;
@@ -104,14 +110,18 @@ struct sch_obj {
 };
 
 struct sheet {
-	const char *title;		/* malloced, unless delta */
+	const char *title;		/* interned */
 	const char *file;		/* file name; idem */
 	const char *path;		/* schematics path; idem */
 	struct sch_obj *objs;
+	struct arena *objs_arena;	/* reference to the arena of objs if
+					   borrowed from other sch_ctx */
 	struct sch_obj **next_obj;
 	struct sheet *next;
 
 	time_t mtime;			/* file / commit time */
+	dev_t dev;			/* file identity, 0 if VCS */
+	ino_t ino;
 
 	/* header items */
 	const char *size;		/* paper size, from $Descr */
@@ -124,6 +134,16 @@ struct sheet {
 
 	bool has_children;		/* aka sub-sheets */
 
+	/* components, looked up when first used */
+	const struct lib *lib;
+	const char **syms;		/* names of the symbols used; lives with
+					   the objects */
+	unsigned n_syms;
+	const struct comp **comps;	/* indexed like syms */
+	const struct lib *embedded;	/* symbols stored in the sheet file,
+					   searched before "lib"; lives with
+					   the objects, NULL if none */
+
 	/* caching */
 	void *oid;
 };
@@ -131,26 +151,47 @@ struct sheet {
 struct sch_ctx {
 	enum sch_state state;
 
+	struct arena *arena;		/* everything we parse goes here */
+
 	bool recurse;
 
 	struct sch_obj obj;
+	struct sch_sexpr *sexpr;	/* .kicad_sch parser state; NULL if
+					   none */
 
 	struct sheet *curr_sheet;
 	struct sheet *sheets;
 	struct sheet **next_sheet;
 
-	/* for caching */
-	const struct sch_ctx *prev;
-
 	const struct lib *lib;
+
+	struct hash *parsed;		/* leaf sheets, by file identity */
+
+	/* for parsing sub-sheets in parallel */
+	bool parallel;
+	struct sch_job *jobs;		/* sub-sheets, in order of appearance */
+	struct sch_job **next_job;
 };
 
 
 void decode_alignment(struct text *txt, char hor, char vert);
 
+const struct comp *sch_find_comp(const struct sheet *sheet,
+    const struct sch_comp *comp);
+char *sch_comp_ref(const struct sheet *sheet, const struct sch_comp *comp,
+    const char *ref);
 void sch_render(const struct sheet *sheet, struct gfx *gfx);
-bool sch_parse(struct sch_ctx *ctx, struct file *file, const struct lib *lib,
-    const struct sch_ctx *prev);
+
+struct sch_obj *sch_submit_obj(struct sch_ctx *ctx, enum sch_obj_type type);
+void sch_submit_sheet(struct sch_ctx *ctx, const struct file *file);
+void sch_add_comment(struct sch_ctx *ctx, struct sheet *sheet, unsigned n,
+    const char *s);
+
+bool sch_sexpr_parse_line(struct sch_ctx *ctx, const struct file *file,
+    const char *line);
+void sch_sexpr_free(struct sch_ctx *ctx);
+
+bool sch_parse(struct sch_ctx *ctx, struct file *file, const struct lib *lib);
 void sch_init(struct sch_ctx *ctx, bool recurse);
 void sch_free(struct sch_ctx *ctx);
 
@@ -0,0 +1,224 @@
+/*
+ * kicad/sexpr-item.c - Build S-expression items from a stream
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "misc/util.h"
+#include "misc/arena.h"
+#include "gfx/text.h"
+#include "kicad/kicad.h"
+#include "kicad/sexpr.h"
+#include "kicad/sexpr-item.h"
+
+
+struct sexpr_item {
+	struct arena *arena;	/* the current item; NULL if none */
+	struct expr *e;
+
+	struct expr ***stack;	/* where the next expression goes, per level */
+	unsigned depth;
+	unsigned max_depth;
+};
+
+
+/* ----- Building ---------------------------------------------------------- */
+
+
+static struct expr *add_expr(struct sexpr_item *item)
+{
+	struct expr *e = arena_alloc_type(item->arena, struct expr);
+
+	e->s = NULL;
+	e->e = NULL;
+	e->next = NULL;
+
+	*item->stack[item->depth] = e;
+	item->stack[item->depth] = &e->next;
+	return e;
+}
+
+
+void sexpr_item_begin(struct sexpr_item *item)
+{
+	arena_unref(item->arena);
+	item->arena = arena_new();
+	item->e = NULL;
+	item->depth = 0;
+	item->stack[0] = &item->e;
+}
+
+
+void sexpr_item_atom(struct sexpr_item *item, const char *s)
+{
+	struct expr *e = add_expr(item);
+
+	if (*s)
+		e->s = arena_strdup(item->arena, s);
+}
+
+
+void sexpr_item_enter(struct sexpr_item *item)
+{
+	struct expr *e = add_expr(item);
+
+	if (++item->depth == item->max_depth) {
+		item->max_depth *= 2;
+		item->stack = realloc_type_n(item->stack, struct expr **,
+		    item->max_depth);
+	}
+	item->stack[item->depth] = &e->e;
+}
+
+
+/*
+ * Returns 1 when we leave the list the item began with.
+ */
+
+bool sexpr_item_leave(struct sexpr_item *item)
+{
+	return !item->depth--;
+}
+
+
+const struct expr *sexpr_item_expr(const struct sexpr_item *item)
+{
+	return item->e;
+}
+
+
+/* ----- Accessors --------------------------------------------------------- */
+
+
+const struct expr *sexpr_find(const struct expr *e, const char *kw)
+{
+	if (!e)
+		return NULL;
+	for (e = e->next; e; e = e->next)
+		if (e->e && e->e->s && !strcmp(e->e->s, kw))
+			return e->e;
+	return NULL;
+}
+
+
+const char *sexpr_arg(const struct expr *e, unsigned n)
+{
+	if (!e)
+		return NULL;
+	for (e = e->next; e && n; e = e->next)
+		n--;
+	if (!e || e->e)
+		return NULL;
+	return e->s ? e->s : "";
+}
+
+
+bool sexpr_num(const struct expr *e, unsigned n, double *res)
+{
+	const char *s = sexpr_arg(e, n);
+	char *end;
+
+	if (!s || !*s)
+		return 0;
+	*res = strtod(s, &end);
+	return !*end;
+}
+
+
+bool sexpr_flag(const struct expr *e, const char *s)
+{
+	const struct expr *sub;
+
+	if (!e)
+		return 0;
+	for (sub = e->next; sub; sub = sub->next)
+		if (sub->s && !strcmp(sub->s, s))
+			return 1;
+	sub = sexpr_find(e, s);
+	return sub && sexpr_arg(sub, 0) && !strcmp(sexpr_arg(sub, 0), "yes");
+}
+
+
+bool sexpr_xy(const struct expr *e, const char *kw, int *x, int *y)
+{
+	const struct expr *xy = sexpr_find(e, kw);
+	double fx, fy;
+
+	if (!sexpr_num(xy, 0, &fx) || !sexpr_num(xy, 1, &fy))
+		return 0;
+	*x = mm_to_mil(fx);
+	*y = mm_to_mil(fy);
+	return 1;
+}
+
+
+int sexpr_angle(const struct expr *e)
+{
+	double a;
+
+	if (!sexpr_num(sexpr_find(e, "at"), 2, &a))
+		return 0;
+	return ((int) lround(a) % 360 + 360) % 360;
+}
+
+
+/*
+ * (effects (font (size h w) [bold] [italic]) (justify ...) [hide])
+ */
+
+void sexpr_effects(const struct expr *e, int *size, enum text_style *style,
+    char *hor, char *vert, bool *hidden)
+{
+	const struct expr *effects = sexpr_find(e, "effects");
+	const struct expr *font = sexpr_find(effects, "font");
+	const struct expr *justify = sexpr_find(effects, "justify");
+	double h;
+
+	*size = sexpr_num(sexpr_find(font, "size"), 0, &h) ? mm_to_mil(h) : 50;
+	*style = text_normal;
+	if (sexpr_flag(font, "italic"))
+		*style |= text_italic;
+	if (sexpr_flag(font, "bold"))
+		*style |= text_bold;
+	*hor = sexpr_flag(justify, "left") ? 'L' :
+	    sexpr_flag(justify, "right") ? 'R' : 'C';
+	*vert = sexpr_flag(justify, "top") ? 'T' :
+	    sexpr_flag(justify, "bottom") ? 'B' : 'C';
+	*hidden = sexpr_flag(effects, "hide") || sexpr_flag(e, "hide");
+}
+
+
+/* ----- Creation and destruction ------------------------------------------ */
+
+
+struct sexpr_item *sexpr_item_new(void)
+{
+	struct sexpr_item *item;
+
+	item = alloc_type(struct sexpr_item);
+	item->arena = NULL;
+	item->e = NULL;
+	item->depth = 0;
+	item->max_depth = 16;
+	item->stack = alloc_type_n(struct expr **, item->max_depth);
+	return item;
+}
+
+
+void sexpr_item_free(struct sexpr_item *item)
+{
+	arena_unref(item->arena);
+	free(item->stack);
+	free(item);
+}
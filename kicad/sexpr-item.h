@@ -0,0 +1,73 @@
+/*
+ * kicad/sexpr-item.h - Build S-expression items from a stream
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef KICAD_SEXPR_ITEM_H
+#define	KICAD_SEXPR_ITEM_H
+
+#include <stdbool.h>
+
+#include "gfx/text.h"
+#include "kicad/sexpr.h"
+
+
+/*
+ * Large files, such as .kicad_sch, are streamed, but each item (e.g., a wire
+ * or a symbol) is easier to process as a tree. An item collects the events of
+ * one list into a tree of its own, which is freed when the next item begins.
+ * Memory use therefore depends on the largest item, not on the file.
+ *
+ * The tree returned by sexpr_item_expr is the content of the list, i.e., its
+ * first element is the keyword.
+ */
+
+struct sexpr_item;
+
+
+void sexpr_item_begin(struct sexpr_item *item);
+void sexpr_item_atom(struct sexpr_item *item, const char *s);
+void sexpr_item_enter(struct sexpr_item *item);
+bool sexpr_item_leave(struct sexpr_item *item);
+const struct expr *sexpr_item_expr(const struct sexpr_item *item);
+
+struct sexpr_item *sexpr_item_new(void);
+void sexpr_item_free(struct sexpr_item *item);
+
+
+/*
+ * Accessors for the content of a list:
+ *
+ * sexpr_find returns the content of the first sub-list with the keyword "kw",
+ * sexpr_arg the n-th string after the keyword (counting from zero), and
+ * sexpr_num the same, converted to a number. sexpr_flag checks whether the
+ * word "s" appears after the keyword, either on its own or as (s yes).
+ *
+ * sexpr_xy gets the coordinates of (kw x y ...) in mils, and sexpr_angle the
+ * angle of (at x y angle) in degrees, in the range 0 to 359 (0 if absent).
+ */
+
+const struct expr *sexpr_find(const struct expr *e, const char *kw);
+const char *sexpr_arg(const struct expr *e, unsigned n);
+bool sexpr_num(const struct expr *e, unsigned n, double *res);
+bool sexpr_flag(const struct expr *e, const char *s);
+bool sexpr_xy(const struct expr *e, const char *kw, int *x, int *y);
+int sexpr_angle(const struct expr *e);
+
+/*
+ * Text attributes of an item, from its (effects ...). The size is in mils, the
+ * alignment is L, R, or C horizontally, and T, B, or C vertically.
+ */
+
+void sexpr_effects(const struct expr *e, int *size, enum text_style *style,
+    char *hor, char *vert, bool *hidden);
+
+#endif /* !KICAD_SEXPR_ITEM_H */
@@ -17,14 +17,11 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
 #include "kicad/sexpr.h"
 
 
-struct stack {
-	struct expr **next;
-	struct stack *prev;
-};
-
 struct sexpr_ctx {
 	enum sexpr_state {
 		idle,
@@ -33,87 +30,112 @@ struct sexpr_ctx {
 		escape,
 		failed
 	} state;
+	struct arena *arena;	/* expressions and strings */
+	struct hash *atoms;	/* interned strings */
+	const struct sexpr_ops *ops; /* streaming, if non-NULL */
+	void *user;
 	struct expr *e;		/* expression */
 	const char *p;		/* beginning of string */
-	struct stack *sp;
-	struct stack stack;
+
+	char *buf;		/* string being assembled */
+	unsigned len;
+	unsigned size;
+
+	struct expr ***stack;	/* where the next expression goes, per level */
+	unsigned depth;
+	unsigned max_depth;
 };
 
 
+/* ----- Interned strings -------------------------------------------------- */
+
+
+const char *sexpr_intern(struct sexpr_ctx *ctx, const char *s)
+{
+	char *atom;
+
+	atom = hash_lookup(ctx->atoms, s);
+	if (!atom) {
+		atom = arena_strdup(ctx->arena, s);
+		hash_insert(ctx->atoms, atom, atom);
+	}
+	return atom;
+}
+
+
 /* ----- Parser ------------------------------------------------------------ */
 
 
 static bool pop(struct sexpr_ctx *ctx)
 {
-	struct stack *prev;
-
-	if (!ctx->sp->prev) {
+	if (!ctx->depth) {
 		error("too many )");
 		return 0;
 	}
-	prev = ctx->sp->prev;
-	free(ctx->sp);
-	ctx->sp = prev;
+	if (ctx->ops && !ctx->ops->leave(ctx->user, ctx->depth))
+		return 0;
+	ctx->depth--;
 	return 1;
 }
 
 
-static void new_expr(struct sexpr_ctx *ctx)
+static struct expr *add_expr(struct sexpr_ctx *ctx)
 {
-	struct stack *st = alloc_type(struct stack);
-	struct expr *e = alloc_type(struct expr);
+	struct expr *e = arena_alloc_type(ctx->arena, struct expr);
 
 	e->s = NULL;
 	e->e = NULL;
 	e->next = NULL;
 
-	*ctx->sp->next = e;
-	ctx->sp->next = &e->next;
-
-	st->prev = ctx->sp;
-	st->next = &e->e;
-	ctx->sp = st;
+	*ctx->stack[ctx->depth] = e;
+	ctx->stack[ctx->depth] = &e->next;
+	return e;
 }
 
 
-static void add_string(struct sexpr_ctx *ctx, const char *end)
+static bool new_expr(struct sexpr_ctx *ctx)
 {
 	struct expr *e;
-	unsigned old;
-	unsigned new = end - ctx->p;
 
-	e = *ctx->sp->next;
-	if (e) {
-		old = strlen(e->s);
-	} else {
-		e = alloc_type(struct expr);
-		e->s = NULL;
-		e->e = NULL;
-		e->next = NULL;
-
-		*ctx->sp->next = e;
-		old = 0;
+	if (ctx->ops) {
+		ctx->depth++;
+		return ctx->ops->enter(ctx->user, ctx->depth);
+	}
+
+	e = add_expr(ctx);
+	if (++ctx->depth == ctx->max_depth) {
+		ctx->max_depth *= 2;
+		ctx->stack = realloc_type_n(ctx->stack, struct expr **,
+		    ctx->max_depth);
 	}
+	ctx->stack[ctx->depth] = &e->e;
+	return 1;
+}
 
-	if (!new)
-		return;
 
-	e->s = realloc_size(e->s, old + new + 1);
-	memcpy(e->s + old, ctx->p, new);
-	e->s[old + new] = 0;
+static void add_string(struct sexpr_ctx *ctx, const char *end)
+{
+	unsigned new = end - ctx->p;
+
+	if (ctx->len + new >= ctx->size) {
+		ctx->size = (ctx->len + new + 1) * 2;
+		ctx->buf = realloc_size(ctx->buf, ctx->size);
+	}
+	memcpy(ctx->buf + ctx->len, ctx->p, new);
+	ctx->len += new;
 }
 
 
-static void end_string(struct sexpr_ctx *ctx, const char *end)
+static bool end_string(struct sexpr_ctx *ctx, const char *end)
 {
 	struct expr *e;
+	const char *atom;
 	char *s, *t;
 
 	add_string(ctx, end);
-	e = *ctx->sp->next;
-	ctx->sp->next = &e->next;
+	ctx->buf[ctx->len] = 0;
 
-	for (s = t = e->s; *s; s++) {
+	for (s = t = ctx->buf; *s; s++) {
 		if (*s == '\\')
 			switch (*++s) {
 			case 'n':
@@ -130,6 +152,18 @@ static void end_string(struct sexpr_ctx *ctx, const char *end)
 		*t++ = *s;
 	}
 	*t = 0;
+	ctx->len = 0;
+
+	if (ctx->ops) {
+		atom = hash_lookup(ctx->atoms, ctx->buf);
+		return ctx->ops->atom(ctx->user, atom ? atom : ctx->buf,
+		    ctx->depth);
+	}
+
+	e = add_expr(ctx);
+	if (*ctx->buf)
+		e->s = sexpr_intern(ctx, ctx->buf);
+	return 1;
 }
 
 
@@ -146,7 +180,8 @@ bool sexpr_parse(struct sexpr_ctx *ctx, const char *s)
 			case '\n':
 				break;
 			case '(':
-				new_expr(ctx);
+				if (!new_expr(ctx))
+					ctx->state = failed;
 				break;
 			case ')':
 				if (!pop(ctx))
@@ -168,14 +203,12 @@ bool sexpr_parse(struct sexpr_ctx *ctx, const char *s)
 			case '\t':
 			case '\r':
 			case '\n':
-				ctx->state = idle;
-				end_string(ctx, s);
+				ctx->state = end_string(ctx, s) ? idle : failed;
 				break;
 			case '(':
 			case ')':
 			case '"':
-				ctx->state = idle;
-				end_string(ctx, s);
+				ctx->state = end_string(ctx, s) ? idle : failed;
 				continue;
 			default:
 				break;
@@ -189,8 +222,7 @@ bool sexpr_parse(struct sexpr_ctx *ctx, const char *s)
 				error("newline in string");
 				break;
 			case '"':
-				ctx->state = idle;
-				end_string(ctx, s);
+				ctx->state = end_string(ctx, s) ? idle : failed;
 				break;
 			case '\\':
 				ctx->state = escape;
@@ -269,51 +301,33 @@ void dump_expr(const struct expr *e)
 }
 
 
-/* ----- Cleanup ----------------------------------------------------------- */
+/* ----- Parser creation --------------------------------------------------- */
 
 
-static void free_stack(struct sexpr_ctx *ctx)
+struct sexpr_ctx *sexpr_new(void)
 {
-	struct stack *prev;
-
-	while (ctx->sp != &ctx->stack) {
-		prev = ctx->sp->prev;
-		free(ctx->sp);
-		ctx->sp = prev;
-	}
+	return sexpr_new_stream(NULL, NULL);
 }
 
 
-void free_expr(struct expr *e)
-{
-	struct expr *next;
-
-	while (e) {
-		next = e->next;
-		if (e->s)
-			free(e->s);
-		else if (e->e)
-			free_expr(e->e);
-		free(e);
-		e = next;
-	}
-}
-
-
-/* ----- Parser creation --------------------------------------------------- */
-
-
-struct sexpr_ctx *sexpr_new(void)
+struct sexpr_ctx *sexpr_new_stream(const struct sexpr_ops *ops, void *user)
 {
 	struct sexpr_ctx *ctx;
 
 	ctx = alloc_type(struct sexpr_ctx);
 	ctx->state = idle;
+	ctx->arena = arena_new();
+	ctx->atoms = hash_new(ctx->arena, hash_str, hash_str_eq);
+	ctx->ops = ops;
+	ctx->user = user;
 	ctx->e = NULL;
 	ctx->p = NULL;
-	ctx->sp = &ctx->stack;
-	ctx->stack.next = &ctx->e;
-	ctx->stack.prev = NULL;
+	ctx->buf = NULL;
+	ctx->len = ctx->size = 0;
+	ctx->max_depth = 16;
+	ctx->stack = alloc_type_n(struct expr **, ctx->max_depth);
+	ctx->stack[0] = &ctx->e;
+	ctx->depth = 0;
 	return ctx;
 }
 
@@ -321,30 +335,31 @@ struct sexpr_ctx *sexpr_new(void)
 /* ----- Termination ------------------------------------------------------- */
 
 
-void sexpr_abort(struct sexpr_ctx *ctx)
-{
-	free_stack(ctx);
-	free_expr(ctx->e);
-	free(ctx);
-}
-
+/*
+ * On success, the expression remains valid until the context is freed. When
+ * streaming, there is no expression and *res is set to NULL.
+ */
 
 bool sexpr_finish(struct sexpr_ctx *ctx, struct expr **res)
 {
-	if (ctx->sp != &ctx->stack) {
+	if (ctx->depth) {
 		error("not enough )");
 		ctx->state = failed;
 	}
 	if (ctx->state != idle && ctx->state != failed)
 		error("invalid end state %d", ctx->state);
-	if (ctx->state != idle) {
-		sexpr_abort(ctx);
+	if (ctx->state != idle)
 		return 0;
-	}
 	if (res)
 		*res = ctx->e;
-	else
-		free_expr(ctx->e);
-	free(ctx);
 	return 1;
 }
+
+
+void sexpr_free(struct sexpr_ctx *ctx)
+{
+	arena_unref(ctx->arena);
+	free(ctx->buf);
+	free(ctx->stack);
+	free(ctx);
+}
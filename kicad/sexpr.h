@@ -18,6 +18,13 @@
 
 
 /*
+ * All expressions and strings of a parse live in an arena that belongs to the
+ * parser context, and are freed all at once with sexpr_free.
+ *
+ * Strings are interned, i.e., all occurrences of the same string share the
+ * same pointer. Callers can obtain the pointer for a given string with
+ * sexpr_intern and then compare pointers instead of strings.
+ *
  * Expression type:
  *
  * s		e		Meaning
@@ -29,20 +36,42 @@
  */
 
 struct expr {
-	char *s;		/* string or NULL */
+	const char *s;		/* interned string or NULL */
 	struct expr *e;		/* sub-sexpr or NULL*/
 	struct expr *next;
 };
 
+/*
+ * Streaming: instead of building expressions, the parser reports the start
+ * and the end of each list, and each string, as it encounters them. "depth"
+ * is the nesting level of the list, 1 for lists at the top level. Strings
+ * are passed with the depth of the list containing them.
+ *
+ * The string passed to "atom" is only valid during the call, unless it has
+ * been interned before, in which case the interned pointer is passed. Since
+ * the parser does not intern strings when streaming, memory use only depends
+ * on the nesting depth and the length of the longest string.
+ *
+ * If a callback returns 0, parsing fails.
+ */
+
+struct sexpr_ops {
+	bool (*enter)(void *user, unsigned depth);
+	bool (*atom)(void *user, const char *s, unsigned depth);
+	bool (*leave)(void *user, unsigned depth);
+};
+
 struct sexpr_ctx;
 
 
 void dump_expr(const struct expr *e);
-void free_expr(struct expr *e);
+
+const char *sexpr_intern(struct sexpr_ctx *ctx, const char *s);
 
 struct sexpr_ctx *sexpr_new(void);
+struct sexpr_ctx *sexpr_new_stream(const struct sexpr_ops *ops, void *user);
 bool sexpr_parse(struct sexpr_ctx *ctx, const char *s);
-void sexpr_abort(struct sexpr_ctx *ctx);
 bool sexpr_finish(struct sexpr_ctx *ctx, struct expr **res);
+void sexpr_free(struct sexpr_ctx *ctx);
 
 #endif /* !KICAD_SEXPR_H */
@@ -0,0 +1,192 @@
+/*
+ * kicad/tok.c - Tokenizer for the line-based KiCad formats
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "kicad/tok.h"
+
+
+static inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' ||
+	    c == '\v' || c == '\f';
+}
+
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+
+static inline const char *skip(const char *s)
+{
+	while (is_space(*s))
+		s++;
+	return s;
+}
+
+
+/* ----- Keywords ---------------------------------------------------------- */
+
+
+/*
+ * tok_is matches a whole word. tok_prefix only matches the beginning of a
+ * word, e.g., "F" in "F0", like a literal in a scanf format would.
+ */
+
+bool tok_is(struct tok *tok, const char *kw)
+{
+	const char *p = skip(tok->s);
+	size_t len = strlen(kw);
+
+	if (strncmp(p, kw, len))
+		return 0;
+	if (p[len] && !is_space(p[len]))
+		return 0;
+	tok->s = p + len;
+	return 1;
+}
+
+
+bool tok_prefix(struct tok *tok, const char *kw)
+{
+	const char *p = skip(tok->s);
+	size_t len = strlen(kw);
+
+	if (strncmp(p, kw, len))
+		return 0;
+	tok->s = p + len;
+	return 1;
+}
+
+
+/* ----- Strings ----------------------------------------------------------- */
+
+
+bool tok_word(struct tok *tok, const char **s, unsigned *len)
+{
+	const char *p = skip(tok->s);
+	const char *q;
+
+	for (q = p; *q && !is_space(*q); q++);
+	if (q == p)
+		return 0;
+	*s = p;
+	*len = q - p;
+	tok->s = q;
+	return 1;
+}
+
+
+/*
+ * A string in double quotes. The string can contain \" and other escapes,
+ * which we return as they are.
+ */
+
+bool tok_str(struct tok *tok, const char **s, unsigned *len)
+{
+	const char *p = skip(tok->s);
+	const char *q;
+
+	if (*p != '"')
+		return 0;
+	for (q = p + 1; *q && *q != '"'; q++)
+		if (*q == '\\' && q[1])
+			q++;
+	if (*q != '"')
+		return 0;
+	*s = p + 1;
+	*len = q - p - 1;
+	tok->s = q + 1;
+	return 1;
+}
+
+
+/* ----- Numbers ----------------------------------------------------------- */
+
+
+/*
+ * Like %d and %u, we accept an optional sign and stop at the first character
+ * that isn't a digit.
+ */
+
+static bool number(struct tok *tok, unsigned *res)
+{
+	const char *p = skip(tok->s);
+	bool neg = *p == '-';
+	unsigned n = 0;
+
+	if (*p == '-' || *p == '+')
+		p++;
+	if (!is_digit(*p))
+		return 0;
+	while (is_digit(*p))
+		n = n * 10 + *p++ - '0';
+	*res = neg ? -n : n;
+	tok->s = p;
+	return 1;
+}
+
+
+bool tok_int(struct tok *tok, int *res)
+{
+	unsigned n;
+
+	if (!number(tok, &n))
+		return 0;
+	*res = n;
+	return 1;
+}
+
+
+bool tok_unsigned(struct tok *tok, unsigned *res)
+{
+	return number(tok, res);
+}
+
+
+/* ----- Characters -------------------------------------------------------- */
+
+
+/*
+ * tok_char is " %c", i.e., it skips whitespace. tok_next_char is "%c" and
+ * returns the character right after the previous token.
+ */
+
+bool tok_char(struct tok *tok, char *c)
+{
+	const char *p = skip(tok->s);
+
+	if (!*p)
+		return 0;
+	*c = *p;
+	tok->s = p + 1;
+	return 1;
+}
+
+
+bool tok_next_char(struct tok *tok, char *c)
+{
+	if (!*tok->s)
+		return 0;
+	*c = *tok->s++;
+	return 1;
+}
+
+
+bool tok_end(struct tok *tok)
+{
+	return !*skip(tok->s);
+}
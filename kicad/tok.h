@@ -0,0 +1,58 @@
+/*
+ * kicad/tok.h - Tokenizer for the line-based KiCad formats
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef KICAD_TOK_H
+#define KICAD_TOK_H
+
+#include <stdbool.h>
+#include <string.h>
+
+
+/*
+ * The tokenizer works on a single line. All functions that take a token skip
+ * leading whitespace (like the scanf conversions they replace) and return 0
+ * without consuming anything if the next token doesn't have the expected
+ * form. Strings returned by the tokenizer point into the line and are not
+ * NUL-terminated.
+ */
+
+struct tok {
+	const char *s;	/* rest of the line */
+};
+
+
+static inline void tok_init(struct tok *tok, const char *line)
+{
+	tok->s = line;
+}
+
+
+/* compare a (non-terminated) token with a NUL-terminated string */
+
+static inline bool tok_eq(const char *s, unsigned len, const char *kw)
+{
+	return !strncmp(s, kw, len) && !kw[len];
+}
+
+
+bool tok_is(struct tok *tok, const char *kw);
+bool tok_prefix(struct tok *tok, const char *kw);
+bool tok_word(struct tok *tok, const char **s, unsigned *len);
+bool tok_str(struct tok *tok, const char **s, unsigned *len);
+bool tok_int(struct tok *tok, int *res);
+bool tok_unsigned(struct tok *tok, unsigned *res);
+bool tok_char(struct tok *tok, char *c);
+bool tok_next_char(struct tok *tok, char *c);
+bool tok_end(struct tok *tok);
+
+#endif /* !KICAD_TOK_H */
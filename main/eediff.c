@@ -28,6 +28,7 @@
 #include "kicad/pl.h"
 #include "kicad/lib.h"
 #include "kicad/sch.h"
+#include "kicad/cache.h"
 #include "kicad/pro.h"
 #include "version.h"
 #include "main/common.h"
@@ -43,7 +44,7 @@ void usage(const char *name)
 "       %s gdb ...\n"
 "\n"
 "  kicad_files  [rev:]file.ext\n"
-"    ext        .pro, .lib, .sch, or .kicad_wks\n"
+"    ext        .pro, .lib, .kicad_sym, .sch, .kicad_sch, or .kicad_wks\n"
 "    rev        git revision\n"
 "  Libraries and page layout precede project and sheet. Sheet (if present)\n"
 "  follows project. At least one of sheet or project must be present.\n"
@@ -129,10 +130,10 @@ int main(int argc, char **argv)
 	free_file_names(&file_names_a);
 	free_file_names(&file_names_b);
 	free(opts);
+	cache_free();
 
 	retval = gfx_end(gfx, 0);
 
-	file_cleanup();
 	cairo_debug_reset_static_data();
 
 	return retval;
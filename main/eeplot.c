@@ -22,6 +22,7 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/pool.h"
 #include "gfx/fig.h"
 #include "gfx/cro.h"
 #include "gfx/gfx.h"
@@ -30,6 +31,7 @@
 #include "kicad/pl.h"
 #include "kicad/lib.h"
 #include "kicad/sch.h"
+#include "kicad/cache.h"
 #include "kicad/pro.h"
 #include "version.h"
 #include "main/common.h"
@@ -92,19 +94,22 @@ static const struct gfx_ops *find_by_output(int argc, char **argv)
 void usage(const char *name)
 {
 	fprintf(stderr,
-"usage: %s -o [type:]output_file [-1] [-d date] [-e] [-v ...] [driver_opts]\n"
-"       %*skicad_file ...\n"
+"usage: %s -o [type:]output_file [-1] [-d date] [-e] [-j jobs] [-v ...]\n"
+"       %*s[driver_opts] kicad_file ...\n"
 "       %s -V\n"
 "       %s gdb ...\n"
 "\n"
 "  kicad_file  [rev:]file.ext\n"
-"    ext       .pro, .lib, .sch, or .kicad_wks\n"
+"    ext       .pro, .lib, .kicad_sym, .sch, .kicad_sch, or .kicad_wks\n"
 "    rev       git revision\n"
 "\n"
 "  -1    show only one sheet - do not recurse into sub-sheets\n"
 "  -d date\n"
 "        use the specified string instead of date entries in sheets\n"
 "  -e    show extra information (e.g., pin types)\n"
+"  -j jobs\n"
+"        parse libraries and sub-sheets with up to the specified number of\n"
+"        jobs in parallel (default: 1)\n"
 "  -o [type:]output_file\n"
 "        output file. - for standard output. File type is derived from\n"
 "        extension and can be overridden with type: prefix (fig, png, pdf,\n"
@@ -135,7 +140,7 @@ void usage(const char *name)
 }
 
 
-#define	OPTIONS	"1d:ehvL:OPV"
+#define	OPTIONS	"1d:ehj:vL:OPV"
 
 
 int main(int argc, char **argv)
@@ -143,10 +148,12 @@ int main(int argc, char **argv)
 	struct lib lib;
 	struct sch_ctx sch_ctx;
 	struct file pro_file, sch_file;
+	struct file *lib_files;
 	bool extra = 0;
 	bool one_sheet = 0;
 	struct pl_ctx *pl = NULL;
 	char c;
+	int n;
 	unsigned i;
 	struct file_names file_names;
 	struct file_names *fn = &file_names;
@@ -171,6 +178,12 @@ int main(int argc, char **argv)
 		case 'e':
 			extra = 1;
 			break;
+		case 'j':
+			n = atoi(optarg);
+			if (n < 1)
+				usage(*argv);
+			jobs = n;
+			break;
 		case 'v':
 			verbose++;
 			break;
@@ -220,11 +233,17 @@ int main(int argc, char **argv)
 	if (!file_open(&sch_file, fn->sch, file_names.pro ? &pro_file : NULL))
 		return 1;
 
+	lib_files = alloc_type_n(struct file, fn->n_libs);
 	lib_init(&lib);
 	for (i = 0; i != fn->n_libs; i++)
-		if (!lib_parse_search(&lib, fn->libs[i], fn,
+		if (!lib_find_file(lib_files + i, fn->libs[i], fn,
 		    file_names.pro ? &pro_file : &sch_file))
 			return 1;
+	if (!lib_parse_files(&lib, lib_files, fn->n_libs))
+		return 1;
+	for (i = 0; i != fn->n_libs; i++)
+		file_close(lib_files + i);
+	free(lib_files);
 
 	if (file_names.pro)
 		file_close(&pro_file);
@@ -239,7 +258,7 @@ int main(int argc, char **argv)
 	}
 	free_file_names(&file_names);
 
-	if (!sch_parse(&sch_ctx, &sch_file, &lib, NULL))
+	if (!sch_parse(&sch_ctx, &sch_file, &lib))
 		return 1;
 	file_close(&sch_file);
 
@@ -265,8 +284,8 @@ int main(int argc, char **argv)
 	lib_free(&lib);
 	if (pl)
 		pl_free(pl);
+	cache_free();
 
-	file_cleanup();
 	cairo_debug_reset_static_data();
 
 	return retval;
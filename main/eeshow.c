@@ -22,6 +22,7 @@
 
 #include "misc/util.h"
 #include "misc/diag.h"
+#include "misc/pool.h"
 #include "file/file.h"
 #include "kicad/ext.h"
 #include "kicad/pl.h"	// for suppress_page_layout
@@ -36,17 +37,23 @@
 void usage(const char *name)
 {
 	fprintf(stderr,
-"usage: %s [gtk_flags] [-1] [-d file.doc_db] [-N n] kicad_file ...\n"
+"usage: %s [gtk_flags] [-1] [-d file.doc_db] [-j jobs] [-N n]\n"
+"       %*skicad_file ...\n"
 "       %s -V\n"
 "       %s gdb ...\n"
 "\n"
 "  kicad_file  [rev:]file.ext\n"
-"    ext       .pro, .lib, .sch, or .kicad_wks\n"
+"    ext       .pro, .lib, .kicad_sym, .sch, .kicad_sch, or .kicad_wks\n"
 "    rev       git revision\n"
 "\n"
 "  -1    show only one sheet - do not recurse into sub-sheets\n"
 "  -d file.doc_db\n"
 "        load documentation database file (experimental)\n"
+"  -j jobs\n"
+"        run up to the specified number of jobs in parallel when parsing\n"
+"        libraries and sub-sheets, and when loading revisions in the\n"
+"        background. The default, 1, parses sequentially and loads\n"
+"        revisions one at a time.\n"
 "  -v    increase verbosity of diagnostic output\n"
 "  -C width\n"
 "        set width of component pop-up (0: fit content; default is %u)\n"
@@ -57,7 +64,7 @@ void usage(const char *name)
 "  -P    use Pango to render text (experimental, slow)\n"
 "  -V    print revision (version) number and exit\n"
 "  gdb   run eeshow under gdb\n"
-    , name, name, name, comp_pop_width);
+    , name, (int) strlen(name) + 1, "", name, name, comp_pop_width);
 	exit(1);
 }
 
@@ -68,6 +75,7 @@ int main(int argc, char **argv)
 	const char **commands = NULL;
 	unsigned n_commands = 0;
 	int limit = 0;
+	int n;
 	char c;
 	struct file_names file_names;
 	const char *doc_db = NULL;
@@ -77,7 +85,7 @@ int main(int argc, char **argv)
 	gtk_init(&argc, &argv);
 	setlocale(LC_ALL, "C");	/* restore sanity */
 
-	while ((c = getopt(argc, argv, "1d:hvC:E:LN:OPV")) != EOF)
+	while ((c = getopt(argc, argv, "1d:hj:vC:E:LN:OPV")) != EOF)
 		switch (c) {
 		case '1':
 			one_sheet = 1;
@@ -85,6 +93,12 @@ int main(int argc, char **argv)
 		case 'd':
 			doc_db = optarg;
 			break;
+		case 'j':
+			n = atoi(optarg);
+			if (n < 1)
+				usage(*argv);
+			jobs = n;
+			break;
 		case 'v':
 			verbose++;
 			break;
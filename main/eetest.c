@@ -14,11 +14,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include "misc/util.h"
 #include "misc/diag.h"
 #include "file/file.h"
 #include "kicad/sexpr.h"
+#include "kicad/lib.h"
+#include "kicad/sch.h"
 #include "gui/fmt-pango.h"
 #include "file/git-hist.h"
 #include "version.h"
@@ -34,10 +37,104 @@ static void sexpr(void)
 
 	while (getline(&buf, &n, stdin) > 0)
 		sexpr_parse(parser, buf);
-	if (sexpr_finish(parser, &expr))
-		dump_expr(expr);
-	else
+	if (!sexpr_finish(parser, &expr))
 		exit(1);
+	dump_expr(expr);
+	sexpr_free(parser);
+	free(buf);
+}
+
+
+static bool event_enter(void *user, unsigned depth)
+{
+	printf("%*s(\n", (depth - 1) * 2, "");
+	return 1;
+}
+
+
+static bool event_atom(void *user, const char *s, unsigned depth)
+{
+	printf("%*s\"%s\"\n", depth * 2, "", s); /* @@@ escaping */
+	return 1;
+}
+
+
+static bool event_leave(void *user, unsigned depth)
+{
+	printf("%*s)\n", (depth - 1) * 2, "");
+	return 1;
+}
+
+
+static void sexpr_events(void)
+{
+	static const struct sexpr_ops ops = {
+		.enter	= event_enter,
+		.atom	= event_atom,
+		.leave	= event_leave,
+	};
+	struct sexpr_ctx *parser = sexpr_new_stream(&ops, NULL);
+	char *buf = NULL;
+	size_t n = 0;
+
+	while (getline(&buf, &n, stdin) > 0)
+		if (!sexpr_parse(parser, buf))
+			exit(1);
+	if (!sexpr_finish(parser, NULL))
+		exit(1);
+	sexpr_free(parser);
+	free(buf);
+}
+
+
+/*
+ * Parse the libraries and the (top) sheet "reps" times and report how many
+ * lines per second we get through. Sub-sheets are not parsed, so that all the
+ * lines we count come from the files on the command line.
+ */
+
+static void parse_bench(unsigned reps, int n_files, char *const *names)
+{
+	struct file *files;
+	struct lib lib;
+	struct sch_ctx sch_ctx;
+	struct timeval t0, t1;
+	unsigned long lines = 0;
+	double dt;
+	unsigned i;
+	int j;
+
+	if (n_files < 1)
+		fatal("-P needs at least a sheet");
+	files = alloc_type_n(struct file, n_files);
+	gettimeofday(&t0, NULL);
+	for (i = 0; i != reps; i++) {
+		lib_init(&lib);
+		for (j = 0; j != n_files - 1; j++)
+			if (!file_open(files + j, names[j], NULL))
+				exit(1);
+		if (!lib_parse_files(&lib, files, n_files - 1))
+			exit(1);
+
+		sch_init(&sch_ctx, 0);
+		if (!file_open(files + j, names[j], NULL))
+			exit(1);
+		if (!sch_parse(&sch_ctx, files + j, &lib))
+			exit(1);
+
+		for (j = 0; j != n_files; j++) {
+			lines += files[j].lineno;
+			file_close(files + j);
+		}
+		sch_free(&sch_ctx);
+		lib_free(&lib);
+	}
+	gettimeofday(&t1, NULL);
+	free(files);
+
+	dt = t1.tv_sec - t0.tv_sec + (t1.tv_usec - t0.tv_usec) / 1e6;
+	printf("%lu lines in %.3f s, %.0f lines/s\n",
+	    lines, dt, dt ? lines / dt : 0);
 }
 
 
@@ -46,17 +143,22 @@ static void usage(const char *name)
 	fprintf(stderr,
 "usage: %s [-v ...] -C [rev:]file\n"
 "       %s [-v ...] -H path_into_repo\n"
+"       %s [-n repetitions] -P file.lib ... file.sch\n"
 "       %s -S\n"
+"       %s -E\n"
 "       %s -V\n"
 "       %s gdb ...\n"
 "\n"
 "  -v    increase verbosity of diagnostic output\n"
 "  -C    'cat' the file to standard output\n"
 "  -H    show history of repository on standard output\n"
+"  -n    repeat -P that many times (default: 10)\n"
+"  -P    parse libraries and sheet, and report lines per second\n"
 "  -S    parse S-expressions from stdin and dump to stdout\n"
+"  -E    parse S-expressions from stdin and print the parser's events\n"
 "  -V    print revision (version) number and exit\n"
 "  gdb   run eeshow under gdb\n"
-    , name, name, name, name, name);
+    , name, name, name, name, name, name, name);
 	exit(1);
 }
 
@@ -66,11 +168,13 @@ int main(int argc, char **argv)
 	const char *cat = NULL;
 	const char *history = NULL;
 	const char *fmt = NULL;
-	int c;
+	unsigned reps = 10;
+	bool bench = 0;
+	int c, n;
 
 	run_under_gdb(argc, argv);
 
-	while ((c = getopt(argc, argv, "hvC:F:H:SV")) != EOF)
+	while ((c = getopt(argc, argv, "hvC:EF:H:n:PSV")) != EOF)
 		switch (c) {
 		case 'v':
 			verbose++;
@@ -78,12 +182,24 @@ int main(int argc, char **argv)
 		case 'C':
 			cat = optarg;
 			break;
+		case 'E':
+			sexpr_events();
+			return 0;
 		case 'F':
 			fmt = optarg;
 			break;
 		case 'H':
 			history = optarg;
 			break;
+		case 'n':
+			n = atoi(optarg);
+			if (n < 1)
+				usage(*argv);
+			reps = n;
+			break;
+		case 'P':
+			bench = 1;
+			break;
 		case 'S':
 			sexpr();
 			return 0;
@@ -108,6 +224,11 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (bench) {
+		parse_bench(reps, argc - optind, argv + optind);
+		return 0;
+	}
+
 	if (history) {
 		dump_hist(vcs_git_history(history, 0));
 		return 0;
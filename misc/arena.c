@@ -0,0 +1,161 @@
+/*
+ * misc/arena.c - Arena (bump) allocator
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc/util.h"
+#include "misc/arena.h"
+
+
+#define	CHUNK_SIZE	(64 * 1024)
+#define	ALIGN		(sizeof(void *) > sizeof(double) ? \
+			    sizeof(void *) : sizeof(double))
+
+
+struct chunk {
+	struct chunk *next;
+	size_t size;		/* usable size, excluding header */
+	size_t used;
+};
+
+struct attached {
+	struct arena *arena;
+	struct attached *next;
+};
+
+struct arena {
+	struct chunk *chunks;	/* current chunk first */
+	struct attached *attached;
+	unsigned refs;		/* only changed atomically */
+};
+
+
+/* ----- Allocation -------------------------------------------------------- */
+
+
+static struct chunk *new_chunk(struct arena *arena, size_t size)
+{
+	struct chunk *chunk;
+
+	if (size < CHUNK_SIZE)
+		size = CHUNK_SIZE;
+	chunk = alloc_size(sizeof(struct chunk) + ALIGN + size);
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct chunk *chunk = arena->chunks;
+	char *base;
+
+	size = (size + ALIGN - 1) & ~(ALIGN - 1);
+	if (!chunk || chunk->used + size > chunk->size) {
+		chunk = new_chunk(arena, size);
+		/*
+		 * Oversized requests get a chunk of their own. We put it
+		 * behind the current chunk, so that we don't waste the space
+		 * left there.
+		 */
+		if (arena->chunks && size > CHUNK_SIZE / 4) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	base = (char *) (chunk + 1);
+	base += (ALIGN - (size_t) base % ALIGN) % ALIGN;
+	chunk->used += size;
+	return base + chunk->used - size;
+}
+
+
+char *arena_strndup(struct arena *arena, const char *s, size_t len)
+{
+	char *p;
+
+	p = arena_alloc(arena, len + 1);
+	memcpy(p, s, len);
+	p[len] = 0;
+	return p;
+}
+
+
+char *arena_strdup(struct arena *arena, const char *s)
+{
+	return arena_strndup(arena, s, strlen(s));
+}
+
+
+/* ----- Reference counting ------------------------------------------------ */
+
+
+/*
+ * Keep "other" alive for as long as "arena" exists, e.g., if objects in
+ * "arena" point to objects in "other".
+ */
+
+void arena_attach(struct arena *arena, struct arena *other)
+{
+	struct attached *a;
+
+	a = arena_alloc_type(arena, struct attached);
+	a->arena = arena_ref(other);
+	a->next = arena->attached;
+	arena->attached = a;
+}
+
+
+
+struct arena *arena_new(void)
+{
+	struct arena *arena;
+
+	arena = alloc_type(struct arena);
+	arena->chunks = NULL;
+	arena->attached = NULL;
+	arena->refs = 1;
+	return arena;
+}
+
+
+struct arena *arena_ref(struct arena *arena)
+{
+	__atomic_add_fetch(&arena->refs, 1, __ATOMIC_RELAXED);
+	return arena;
+}
+
+
+void arena_unref(struct arena *arena)
+{
+	struct chunk *next;
+	struct attached *a;
+
+	if (!arena || __atomic_sub_fetch(&arena->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+	for (a = arena->attached; a; a = a->next)
+		arena_unref(a->arena);
+	while (arena->chunks) {
+		next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+	free(arena);
+}
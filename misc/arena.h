@@ -0,0 +1,47 @@
+/*
+ * misc/arena.h - Arena (bump) allocator
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef MISC_ARENA_H
+#define MISC_ARENA_H
+
+#include <stddef.h>
+
+
+/*
+ * An arena hands out memory from large chunks and releases everything in one
+ * go when the last reference to it is dropped. Individual allocations are
+ * never freed.
+ *
+ * Allocation is not thread-safe, but arenas whose content is no longer
+ * changed can be shared, and referenced and unreferenced from any thread.
+ */
+
+struct arena;
+
+
+#define	arena_alloc_type(a, t) ((t *) arena_alloc((a), sizeof(t)))
+#define	arena_alloc_type_n(a, t, n) \
+	((t *) arena_alloc((a), sizeof(t) * (n)))
+
+
+void *arena_alloc(struct arena *arena, size_t size);
+char *arena_strdup(struct arena *arena, const char *s);
+char *arena_strndup(struct arena *arena, const char *s, size_t len);
+
+void arena_attach(struct arena *arena, struct arena *other);
+
+struct arena *arena_new(void);
+struct arena *arena_ref(struct arena *arena);
+void arena_unref(struct arena *arena);
+
+#endif /* !MISC_ARENA_H */
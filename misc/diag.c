@@ -25,8 +25,13 @@
 
 unsigned verbose = 0;
 
-static int deferring = 0;
-static char *deferred = NULL;
+/*
+ * Deferral applies to the thread that requested it. Messages are written
+ * with stderr locked, so that output from different threads doesn't mix.
+ */
+
+static __thread int deferring = 0;
+static __thread char *deferred = NULL;
 
 
 /* ----- Specialized diagnostic functions ---------------------------------- */
@@ -95,10 +100,12 @@ void fatal(const char *fmt, ...)
 	va_list ap;
 
 	diag_defer_finish(1);
+	flockfile(stderr);
 	va_start(ap, fmt);
 	vfprintf(stderr, fmt, ap);
 	va_end(ap);
 	fprintf(stderr, "\n");
+	funlockfile(stderr);
 	exit(1); /* @@@ for now ... */
 }
 
@@ -121,11 +128,13 @@ void warning(const char *fmt, ...)
 {
 	va_list ap;
 
+	flockfile(stderr);
 	va_start(ap, fmt);
 	fprintf(stderr, "warning: ");
 	vfprintf(stderr, fmt, ap);
 	va_end(ap);
 	fprintf(stderr, "\n");
+	funlockfile(stderr);
 }
 
 
@@ -135,9 +144,11 @@ void progress(unsigned level, const char *fmt, ...)
 
 	if (level > verbose)
 		return;
+	flockfile(stderr);
 	va_start(ap, fmt);
 	fprintf(stderr, "%*s", level * 2, "");
 	vfprintf(stderr, fmt, ap);
 	va_end(ap);
 	fprintf(stderr, "\n");
+	funlockfile(stderr);
 }
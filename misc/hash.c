@@ -0,0 +1,171 @@
+/*
+ * misc/hash.c - Hash tables
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "misc/arena.h"
+#include "misc/hash.h"
+
+
+#define	INITIAL_BUCKETS	64	/* must be a power of two */
+
+
+struct hash_entry {
+	const void *key;
+	void *value;
+	unsigned hash;
+	struct hash_entry *next;
+};
+
+struct hash {
+	struct arena *arena;
+	bool own_arena;
+
+	unsigned (*hash)(const void *key);
+	bool (*eq)(const void *a, const void *b);
+
+	struct hash_entry **buckets;
+	unsigned n_buckets;
+	unsigned n_entries;
+};
+
+
+/* ----- Lookup ------------------------------------------------------------ */
+
+
+void *hash_lookup(const struct hash *hash, const void *key)
+{
+	unsigned h = hash->hash(key);
+	const struct hash_entry *e;
+
+	for (e = hash->buckets[h & (hash->n_buckets - 1)]; e; e = e->next)
+		if (e->hash == h && hash->eq(e->key, key))
+			return e->value;
+	return NULL;
+}
+
+
+/* ----- Insertion --------------------------------------------------------- */
+
+
+/*
+ * The old bucket array stays in the arena. Since we double the size each
+ * time, this wastes at most as much as we're using.
+ */
+
+static void grow(struct hash *hash)
+{
+	unsigned n = hash->n_buckets * 2;
+	struct hash_entry **buckets;
+	struct hash_entry *e, *next;
+	unsigned i;
+
+	buckets = arena_alloc_type_n(hash->arena, struct hash_entry *, n);
+	memset(buckets, 0, sizeof(struct hash_entry *) * n);
+	for (i = 0; i != hash->n_buckets; i++)
+		for (e = hash->buckets[i]; e; e = next) {
+			next = e->next;
+			e->next = buckets[e->hash & (n - 1)];
+			buckets[e->hash & (n - 1)] = e;
+		}
+	hash->buckets = buckets;
+	hash->n_buckets = n;
+}
+
+
+/*
+ * Returns 0 if the key is already in the table. The existing entry is left
+ * unchanged, i.e., the first entry for a key wins.
+ */
+
+bool hash_insert(struct hash *hash, const void *key, void *value)
+{
+	unsigned h = hash->hash(key);
+	struct hash_entry **anchor;
+	struct hash_entry *e;
+
+	anchor = hash->buckets + (h & (hash->n_buckets - 1));
+	for (e = *anchor; e; e = e->next)
+		if (e->hash == h && hash->eq(e->key, key))
+			return 0;
+
+	e = arena_alloc_type(hash->arena, struct hash_entry);
+	e->key = key;
+	e->value = value;
+	e->hash = h;
+	e->next = *anchor;
+	*anchor = e;
+
+	if (++hash->n_entries > hash->n_buckets)
+		grow(hash);
+	return 1;
+}
+
+
+/* ----- Strings ----------------------------------------------------------- */
+
+
+/* FNV-1a */
+
+unsigned hash_str(const void *s)
+{
+	const unsigned char *p;
+	unsigned h = 2166136261u;
+
+	for (p = s; *p; p++) {
+		h ^= *p;
+		h *= 16777619;
+	}
+	return h;
+}
+
+
+bool hash_str_eq(const void *a, const void *b)
+{
+	return !strcmp(a, b);
+}
+
+
+/* ----- Creation and destruction ------------------------------------------ */
+
+
+struct hash *hash_new(struct arena *arena,
+    unsigned (*hash_fn)(const void *key),
+    bool (*eq)(const void *a, const void *b))
+{
+	struct hash *hash;
+	bool own = !arena;
+
+	if (own)
+		arena = arena_new();
+	hash = arena_alloc_type(arena, struct hash);
+	hash->arena = arena;
+	hash->own_arena = own;
+	hash->hash = hash_fn;
+	hash->eq = eq;
+	hash->n_buckets = INITIAL_BUCKETS;
+	hash->n_entries = 0;
+	hash->buckets =
+	    arena_alloc_type_n(arena, struct hash_entry *, INITIAL_BUCKETS);
+	memset(hash->buckets, 0,
+	    sizeof(struct hash_entry *) * INITIAL_BUCKETS);
+	return hash;
+}
+
+
+void hash_free(struct hash *hash)
+{
+	if (hash->own_arena)
+		arena_unref(hash->arena);
+}
@@ -0,0 +1,45 @@
+/*
+ * misc/hash.h - Hash tables
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef MISC_HASH_H
+#define MISC_HASH_H
+
+#include <stdbool.h>
+
+#include "misc/arena.h"
+
+
+/*
+ * Hash table mapping keys to values. The table only stores the pointers, so
+ * keys and values must live at least as long as the table.
+ *
+ * The table itself is allocated from an arena. If we're given an arena, the
+ * table lives and dies with it. Otherwise, it has its own arena and is
+ * destroyed with hash_free.
+ */
+
+struct hash;
+
+
+void *hash_lookup(const struct hash *hash, const void *key);
+bool hash_insert(struct hash *hash, const void *key, void *value);
+
+unsigned hash_str(const void *s);
+bool hash_str_eq(const void *a, const void *b);
+
+struct hash *hash_new(struct arena *arena,
+    unsigned (*hash)(const void *key),
+    bool (*eq)(const void *a, const void *b));
+void hash_free(struct hash *hash);
+
+#endif /* !MISC_HASH_H */
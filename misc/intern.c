@@ -0,0 +1,93 @@
+/*
+ * misc/intern.c - Interned strings
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "misc/util.h"
+#include "misc/arena.h"
+#include "misc/hash.h"
+#include "misc/intern.h"
+
+
+/*
+ * The table is split into shards, each with its own lock, so that threads
+ * parsing in parallel rarely wait for each other. Shards are selected by the
+ * top bits of the hash, since each shard's hash table uses the bottom ones.
+ */
+
+#define	SHARD_BITS	6
+#define	SHARDS		(1 << SHARD_BITS)
+
+
+static struct shard {
+	pthread_mutex_t lock;
+	struct arena *arena;
+	struct hash *strings;
+} shards[SHARDS];
+
+
+static void init_shards(void)
+{
+	unsigned i;
+
+	for (i = 0; i != SHARDS; i++) {
+		pthread_mutex_init(&shards[i].lock, NULL);
+		shards[i].arena = arena_new();
+		shards[i].strings =
+		    hash_new(shards[i].arena, hash_str, hash_str_eq);
+	}
+}
+
+
+const char *intern(const char *s)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	struct shard *shard;
+	char *new;
+
+	if (!s)
+		return NULL;
+	pthread_once(&once, init_shards);
+	shard = shards + (hash_str(s) >> (32 - SHARD_BITS));
+
+	pthread_mutex_lock(&shard->lock);
+	new = hash_lookup(shard->strings, s);
+	if (!new) {
+		new = arena_strdup(shard->arena, s);
+		hash_insert(shard->strings, new, new);
+	}
+	pthread_mutex_unlock(&shard->lock);
+	return new;
+}
+
+
+/*
+ * For strings that aren't NUL-terminated, e.g., tokens. Most are short, so we
+ * only go to the heap for long ones.
+ */
+
+const char *intern_n(const char *s, unsigned len)
+{
+	char buf[256];
+	char *tmp = len < sizeof(buf) ? buf : alloc_size(len + 1);
+	const char *res;
+
+	memcpy(tmp, s, len);
+	tmp[len] = 0;
+	res = intern(tmp);
+	if (tmp != buf)
+		free(tmp);
+	return res;
+}
@@ -0,0 +1,28 @@
+/*
+ * misc/intern.h - Interned strings
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef MISC_INTERN_H
+#define MISC_INTERN_H
+
+/*
+ * Each distinct string is stored only once, no matter how many sheets,
+ * libraries, or revisions use it. Interned strings are therefore equal if and
+ * only if their pointers are. They are never freed.
+ *
+ * Interning NULL yields NULL. It is safe to intern from several threads.
+ */
+
+const char *intern(const char *s);
+const char *intern_n(const char *s, unsigned len);
+
+#endif /* !MISC_INTERN_H */
@@ -0,0 +1,172 @@
+/*
+ * misc/pool.c - Worker thread pool
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "misc/util.h"
+#include "misc/diag.h"
+#include "misc/pool.h"
+
+
+unsigned jobs = 1;
+
+static __thread bool in_worker = 0;
+
+
+struct job {
+	void (*fn)(void *user);
+	void *user;
+	struct job *next;
+};
+
+struct pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t work;	/* job queued, or stopping */
+	pthread_cond_t idle;	/* all jobs have finished */
+
+	struct job *queue;
+	struct job **last;
+	unsigned pending;	/* queued or running */
+	bool stop;
+
+	unsigned n_threads;	/* 0 if running jobs synchronously */
+	pthread_t *threads;
+};
+
+
+/* ----- Workers ----------------------------------------------------------- */
+
+
+static void *worker(void *arg)
+{
+	struct pool *pool = arg;
+	struct job *job;
+
+	in_worker = 1;
+	pthread_mutex_lock(&pool->mutex);
+	while (1) {
+		while (!pool->queue && !pool->stop)
+			pthread_cond_wait(&pool->work, &pool->mutex);
+		if (!pool->queue)
+			break;
+		job = pool->queue;
+		pool->queue = job->next;
+		if (!pool->queue)
+			pool->last = &pool->queue;
+		pthread_mutex_unlock(&pool->mutex);
+
+		job->fn(job->user);
+		free(job);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (!--pool->pending)
+			pthread_cond_broadcast(&pool->idle);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+
+/* ----- Jobs -------------------------------------------------------------- */
+
+
+void pool_add(struct pool *pool, void (*fn)(void *user), void *user)
+{
+	struct job *job;
+
+	if (!pool->n_threads) {
+		fn(user);
+		return;
+	}
+
+	job = alloc_type(struct job);
+	job->fn = fn;
+	job->user = user;
+	job->next = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	*pool->last = job;
+	pool->last = &job->next;
+	pool->pending++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+
+void pool_wait(struct pool *pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->pending)
+		pthread_cond_wait(&pool->idle, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+
+/* ----- Setup and teardown ------------------------------------------------ */
+
+
+/*
+ * Jobs may use pools of their own, e.g., when parsing several revisions in
+ * parallel, each of which parses its sub-sheets with a pool. Such nested pools
+ * run their jobs synchronously, so that we don't end up with jobs * jobs
+ * threads.
+ */
+
+struct pool *pool_new(unsigned threads)
+{
+	struct pool *pool;
+	unsigned i;
+	int err;
+
+	pool = alloc_type(struct pool);
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	pool->queue = NULL;
+	pool->last = &pool->queue;
+	pool->pending = 0;
+	pool->stop = 0;
+	pool->n_threads = threads > 1 && !in_worker ? threads : 0;
+	pool->threads = pool->n_threads ?
+	    alloc_type_n(pthread_t, pool->n_threads) : NULL;
+
+	for (i = 0; i != pool->n_threads; i++) {
+		err = pthread_create(pool->threads + i, NULL, worker, pool);
+		if (err)
+			fatal("pthread_create: %s", strerror(err));
+	}
+	return pool;
+}
+
+
+void pool_free(struct pool *pool)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i != pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->idle);
+	free(pool->threads);
+	free(pool);
+}
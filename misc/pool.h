@@ -0,0 +1,35 @@
+/*
+ * misc/pool.h - Worker thread pool
+ *
+ * Written 2026 by agent
+ * Copyright 2026 by agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef MISC_POOL_H
+#define MISC_POOL_H
+
+/*
+ * Maximum number of jobs to run in parallel. With 1 (the default), all jobs
+ * run synchronously in the thread that submits them. The same applies to
+ * pools created by jobs.
+ */
+
+extern unsigned jobs;
+
+
+struct pool;
+
+
+void pool_add(struct pool *pool, void (*fn)(void *user), void *user);
+void pool_wait(struct pool *pool);
+
+struct pool *pool_new(unsigned threads);
+void pool_free(struct pool *pool);
+
+#endif /* !MISC_POOL_H */